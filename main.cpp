@@ -2,7 +2,9 @@
  * @file  main.cpp
  *
  * Creates an animator from sorting_animator.h/cpp with the sorting algorithms
- * from sorting.h and then runs it with a typical event loop.
+ * from sorting.h and then runs it with a typical event loop. The cutoffs of
+ * the sorts come from the tuning profile of this host, if the benchmark has
+ * saved one (see sorting_tuning.h).
  * 
  * @author David Chen <dchen2@andrew.cmu.edu>
  */
@@ -15,6 +17,7 @@
 
 
 int main() {
+    sort_load_tuning(sort_tuning_path());
     SortingAnimator anim;
     anim.add_sort("Selection", selection_sort<SortingDatum>);
     anim.add_sort("Insertion", insertion_sort<SortingDatum>);
@@ -25,6 +28,14 @@ int main() {
     anim.add_sort("Parallel Quicksort", pquick_sort<SortingDatum>);
     anim.add_sort("Randomized Parallel Quicksort", rpquick_sort<SortingDatum>);
     anim.add_sort("std::sort", std_sort<SortingDatum>);
+    anim.add_sort("Counting Sort", counting_sort<SortingDatum>);
+    anim.add_sort("Radix Sort", radix_sort<SortingDatum>);
+    anim.add_sort("Natural Merge", natural_merge_sort<SortingDatum>);
+    anim.add_sort("pdqsort", pdq_sort<SortingDatum>);
+    anim.add_sort("Parallel Samplesort", psample_sort<SortingDatum>);
+    anim.add_sort("Merge Insertion", merge_insertion_sort<SortingDatum>);
+    anim.add_sort("Cycle Sort", cycle_sort<SortingDatum>);
+    anim.add_sort("Auto", auto_sort<SortingDatum>);
     anim.launch();
     while (anim.window.isOpen()) {
         sf::Event event;
@@ -13,6 +13,17 @@
  *      - Quick sort with (naive) parallelism
  *      - Quick sort with (naive) parallelism and random pivot
  *      - std::sort from <algorithm>
+ *      - Counting sort and LSD radix sort (on elements with a SortKey)
+ *      - Natural merge sort
+ *      - Pattern-defeating quicksort (pdqsort)
+ *      - Parallel samplesort
+ *      - Merge insertion (Ford-Johnson), for the fewest comparisons
+ *      - Cycle sort, for the fewest writes
+ *      - An adaptive sort that probes its input and picks one of the above
+ *
+ * The recursive sorts insertion sort short ranges, stop forking below a
+ * grain size, and sample their pivots as set by sort_tuning() (see
+ * sorting_tuning.h); by default they recurse all the way down.
  *
  * @author David Chen <dchen2@andrew.cmu.edu>
  */
@@ -25,8 +36,17 @@
 #include <mutex>
 #include <functional>
 #include <algorithm>
+#include <type_traits>
+#include <utility>
+#include "sorting_stats.h"
+#include "sorting_tuning.h"
 
 
+/*
+ * A comparison function tells whether x may precede y in the output, such
+ * as x <= y, so it holds for equal elements both ways. Sorts that need a
+ * strict order (like std::sort) use !cmp(y, x) instead, which is x < y.
+ */
 template <class T>
 using cmp_fn = std::function<bool(T&, T&)>;
 
@@ -34,6 +54,108 @@ template <class T>
 using sort_fn = std::function<void(std::vector<T>& v, cmp_fn<T> cmp)>;
 
 
+/* Instrumentation (see sorting_stats.h) */
+
+/** @brief Swaps two elements, counting one swap */
+template <class T>
+void sort_swap(T& x, T& y) {
+    sort_count_swap();
+    T temp = x;
+    x = y;
+    y = temp;
+}
+
+/** @brief Wraps a comparison function so that it counts itself */
+template <class T>
+cmp_fn<T> counting_cmp(cmp_fn<T> cmp) {
+    return [cmp](T& x, T& y) {
+        sort_count_cmp();
+        sort_note_read(&x);
+        sort_note_read(&y);
+        return cmp(x, y);
+    };
+}
+
+
+/* Keys */
+
+/**
+ * @brief Integer key of an element, for the sorts that distribute elements
+ *        by key instead of comparing them
+ *
+ * Defined for the integer types that fit in an int64_t and for Counted
+ * wrappers of them; specialize it for other element types. The key sorts
+ * only rely on it when the comparator orders the elements by key (see
+ * sort_key_order()).
+ */
+template <class T, class Enable = void>
+struct SortKey {
+    static const bool keyed = false;
+    static int64_t key(const T&) { return 0; }
+};
+
+template <class T>
+struct SortKey<T, typename std::enable_if<std::is_integral<T>::value
+                      && (std::is_signed<T>::value
+                          || sizeof(T) < sizeof(int64_t))>::type> {
+    static const bool keyed = true;
+    static int64_t key(const T& x) { return (int64_t)x; }
+};
+
+template <class V>
+struct SortKey<Counted<V>> {
+    static const bool keyed = SortKey<V>::keyed;
+    static int64_t key(const Counted<V>& c) {
+        sort_note_read(&c);
+        return SortKey<V>::key(c.value);
+    }
+};
+
+/*
+ * Tells whether cmp orders v by key: 1 if by ascending key, -1 if by
+ * descending key, 0 if not or if T has no key. Only a sample of pairs is
+ * checked, so a comparator agreeing with the keys there is taken to order
+ * by them everywhere.
+ */
+template <class T>
+int sort_key_order(std::vector<T>& v, cmp_fn<T>& cmp) {
+    if (!SortKey<T>::keyed)
+        return 0;
+    const size_t PAIRS = 32;
+    size_t n = v.size();
+    // Order of the pair i, j: 1 or -1 as above, 0 if it contradicts the
+    // keys, and 2 if the keys are equal (and cmp agrees)
+    auto pair_order = [&](size_t i, size_t j) {
+        int64_t a = SortKey<T>::key(v[i]), b = SortKey<T>::key(v[j]);
+        bool ij = cmp(v[i], v[j]), ji = cmp(v[j], v[i]);
+        if (a == b)
+            return ij == ji ? 2 : 0;
+        int o = ij && !ji ? 1 : ji && !ij ? -1 : 0;
+        return a > b ? -o : o;
+    };
+    int order = 0;
+    for (size_t s = 0; s < PAIRS && n >= 2; s++) {
+        size_t i = s * n / PAIRS, j = (i + n / 2) % n;
+        int o = pair_order(i, j);
+        if (o == 2)
+            continue;
+        if (!o || (order && o != order))
+            return 0;
+        order = o;
+    }
+    // Every sampled pair was tied (as in a sawtooth of n / 2): the first
+    // key that differs from the first element's gives the direction
+    for (size_t i = 1; !order && i < n; i++) {
+        if (SortKey<T>::key(v[i]) == SortKey<T>::key(v[0]))
+            continue;
+        order = pair_order(0, i);
+        if (!order)
+            return 0;
+    }
+    return order ? order : 1;
+}
+
+
 /* Selection Sort */
 template <class T>
 void selection_sort(std::vector<T>& v, cmp_fn<T> cmp) {
@@ -43,9 +165,7 @@ void selection_sort(std::vector<T>& v, cmp_fn<T> cmp) {
             if (cmp(v[j], v[smallest]))
                 smallest = j;
         }
-        T temp = v[i];
-        v[i] = v[smallest];
-        v[smallest] = temp;
+        sort_swap(v[i], v[smallest]);
     }
 }
 
@@ -58,11 +178,8 @@ void insertion_sort(std::vector<T>& v, cmp_fn<T> cmp) {
             size_t j = 0;
             while (j < i && cmp(v[j], v[i]))
                 j++;
-            T temp;
             while (j < i) {
-                temp = v[j];
-                v[j] = v[i];
-                v[i] = temp;
+                sort_swap(v[j], v[i]);
                 j++;
             }
         }
@@ -77,12 +194,27 @@ void bubble_sort(std::vector<T>& v, cmp_fn<T> cmp) {
         return;
     for (size_t i = 0; i < v.size(); i++) {
         for (size_t j = 0; j < v.size() - i - 1; j++) {
-            if (cmp(v[j + 1], v[j])) {
-                T temp = v[j];
-                v[j] = v[j + 1];
-                v[j + 1] = temp;
-            }
+            if (!cmp(v[j], v[j + 1]))
+                sort_swap(v[j], v[j + 1]);
+        }
+    }
+}
+
+
+/* Insertion sort of v[lo, hi), the leaves of the recursive sorts */
+template <class T>
+void insertion_sort_range(std::vector<T>& v, cmp_fn<T>& cmp,
+                          size_t lo, size_t hi) {
+    for (size_t i = lo + 1; i < hi; i++) {
+        if (cmp(v[i - 1], v[i]))
+            continue;
+        T temp = v[i];
+        size_t j = i;
+        while (j > lo && !cmp(v[j - 1], temp)) {
+            v[j] = v[j - 1];
+            j--;
         }
+        v[j] = temp;
     }
 }
 
@@ -90,27 +222,30 @@ void bubble_sort(std::vector<T>& v, cmp_fn<T> cmp) {
 /* Merge Sort */
 template <class T> void merge_sort(std::vector<T>& v, cmp_fn<T> cmp);
 
+/* Merges the sorted runs v[lo, mid) and v[mid, hi) */
 template <class T>
-void merge(std::vector<T>& v, cmp_fn<T> cmp, size_t lo, size_t hi) {
-    size_t mid = lo + (hi - lo) / 2;
-    size_t i1 = lo, i2 = mid;
-    std::vector<T> u;
+void merge_runs(std::vector<T>& v, cmp_fn<T>& cmp,
+                size_t lo, size_t mid, size_t hi) {
+    SortSpan span("merge", hi - lo);
+    size_t i1 = lo, i2 = mid, k = 0;
+    std::vector<T> u(hi - lo);
+    SortScratch scratch(u);
     while (i1 < mid || i2 < hi) {
         if (i1 == mid) {
-            u.push_back(v[i2]);
+            u[k++] = v[i2];
             i2++;
         }
         else if (i2 == hi) {
-            u.push_back(v[i1]);
+            u[k++] = v[i1];
             i1++;
         }
         else {
             if (cmp(v[i1], v[i2])) {
-                u.push_back(v[i1]);
+                u[k++] = v[i1];
                 i1++;
             }
             else {
-                u.push_back(v[i2]);
+                u[k++] = v[i2];
                 i2++;
             }
         }
@@ -118,11 +253,19 @@ void merge(std::vector<T>& v, cmp_fn<T> cmp, size_t lo, size_t hi) {
     std::copy(u.begin(), u.end(), v.begin() + lo);
 }
 
+template <class T>
+void merge(std::vector<T>& v, cmp_fn<T> cmp, size_t lo, size_t hi) {
+    merge_runs(v, cmp, lo, lo + (hi - lo) / 2, hi);
+}
+
 template <class T>
 void merge_sort_helper(std::vector<T>& v, cmp_fn<T> cmp,
                        size_t lo, size_t hi) {
-    if (hi - lo <= 1)
+    if (hi - lo <= sort_tuning().leaf) {
+        insertion_sort_range(v, cmp, lo, hi);
         return;
+    }
+    SortSpan span("merge_sort", hi - lo);
     size_t mid = lo + (hi - lo) / 2;
     merge_sort_helper<T>(v, cmp, lo, mid);
     merge_sort_helper<T>(v, cmp, mid, hi);
@@ -141,13 +284,19 @@ template <class T> void pmerge_sort(std::vector<T>& v, cmp_fn<T> cmp);
 template <class T>
 void pmerge_sort_helper(std::vector<T>& v, cmp_fn<T> cmp,
                         size_t lo, size_t hi) {
-    if (hi - lo <= 1)
+    if (hi - lo < sort_tuning().grain) {
+        merge_sort_helper<T>(v, cmp, lo, hi);
         return;
+    }
+    if (hi - lo <= sort_tuning().leaf) {
+        insertion_sort_range(v, cmp, lo, hi);
+        return;
+    }
+    SortSpan span("pmerge_sort", hi - lo);
     size_t mid = lo + (hi - lo) / 2;
-    std::thread head(pmerge_sort_helper<T>, std::ref(v), cmp, lo, mid);
-    std::thread tail(pmerge_sort_helper<T>, std::ref(v), cmp, mid, hi);
-    head.join();
-    tail.join();
+    sort_fork([&]() { pmerge_sort_helper<T>(v, cmp, lo, mid); },
+              [&]() { pmerge_sort_helper<T>(v, cmp, mid, hi); },
+              mid - lo, hi - mid);
     merge(v, cmp, lo, hi);
 };
 
@@ -160,32 +309,81 @@ void pmerge_sort(std::vector<T>& v, cmp_fn<T> cmp) {
 /* Quick Sort */
 template <class T> void quick_sort(std::vector<T>& v, cmp_fn<T> cmp);
 
+/*
+ * Splits v[lo, hi) three ways around the value of v[p] and returns the
+ * bounds of the elements equal to it, relative to lo, which need no more
+ * sorting. Keeping them out of both sides stops inputs with many equal
+ * keys from recursing once per element. Smaller elements fill the scratch
+ * buffer from the front and larger ones from the back, while equal ones
+ * are packed at the front of the range itself, so every group keeps its
+ * relative order.
+ */
 template <class T>
-size_t partition(std::vector<T>& v, cmp_fn<T> cmp, size_t lo, size_t hi, size_t p) {
+std::pair<size_t, size_t> partition(std::vector<T>& v, cmp_fn<T> cmp,
+                                    size_t lo, size_t hi, size_t p) {
+    SortSpan span("partition", hi - lo);
     T vp = v[p];
-    std::vector<T> u1, u2;
+    std::vector<T> u(hi - lo - 1);
+    SortScratch scratch(u);
+    size_t i1 = 0, i2 = u.size(), e = 0;
     for (size_t i = lo; i < hi; i++) {
         if (i == p)
-            continue;
-        if (cmp(v[i], vp))
-            u1.push_back(v[i]);
+            v[lo + e++] = vp;
+        else if (!cmp(vp, v[i]))
+            u[i1++] = v[i];
+        else if (cmp(v[i], vp))
+            v[lo + e++] = v[i];
         else
-            u2.push_back(v[i]);
+            u[--i2] = v[i];
     }
-    std::copy(u1.begin(), u1.end(), v.begin() + lo);
-    v[lo + u1.size()] = vp;
-    std::copy(u2.begin(), u2.end(), v.begin() + lo + u1.size() + 1);
-    return u1.size();
+    std::copy_backward(v.begin() + lo, v.begin() + lo + e,
+                       v.begin() + lo + i1 + e);
+    std::copy(u.begin(), u.begin() + i1, v.begin() + lo);
+    std::copy(u.rbegin(), u.rend() - i2, v.begin() + lo + i1 + e);
+    return std::make_pair(i1, i1 + e);
 }
 
+/*
+ * Picks the pivot of v[lo, hi) as the median of k samples, spread evenly
+ * over the range or drawn at random. With k <= 1 it is the middle element
+ * or a random one.
+ */
+template <class T>
+size_t choose_pivot(std::vector<T>& v, cmp_fn<T> cmp, size_t lo, size_t hi,
+                    bool random) {
+    size_t n = hi - lo;
+    size_t k = std::min(sort_tuning().pivot_sample, n);
+    if (k <= 1)
+        return random ? rand() % n + lo : lo + n / 2;
+    std::vector<size_t> s(k);
+    for (size_t i = 0; i < k; i++)
+        s[i] = random ? rand() % n + lo : lo + (2 * i + 1) * n / (2 * k);
+    for (size_t i = 1; i < k; i++)
+        for (size_t j = i; j > 0 && cmp(v[s[j]], v[s[j - 1]]); j--)
+            std::swap(s[j], s[j - 1]);
+    return s[k / 2];
+}
+
+/*
+ * Recurses into the smaller side and loops on the larger one, so the stack
+ * stays O(log n) deep however badly the pivots split the range.
+ */
 template <class T>
 void quick_sort_helper(std::vector<T>& v, cmp_fn<T> cmp,
-                       size_t lo, size_t hi) {
-    if (hi - lo <= 1)
-        return;
-    size_t p = partition(v, cmp, lo, hi, lo + (hi - lo) / 2);
-    quick_sort_helper(v, cmp, lo, lo + p);
-    quick_sort_helper(v, cmp, lo + p + 1, hi);
+                       size_t lo, size_t hi, bool random = false) {
+    while (hi - lo > sort_tuning().leaf) {
+        SortSpan span("quick_sort", hi - lo);
+        std::pair<size_t, size_t> p = partition(v, cmp, lo, hi,
+            choose_pivot(v, cmp, lo, hi, random));
+        if (p.first < hi - lo - p.second) {
+            quick_sort_helper(v, cmp, lo, lo + p.first, random);
+            lo += p.second;
+        } else {
+            quick_sort_helper(v, cmp, lo + p.second, hi, random);
+            hi = lo + p.first;
+        }
+    }
+    insertion_sort_range(v, cmp, lo, hi);
 }
 
 template <class T>
@@ -197,16 +395,53 @@ void quick_sort(std::vector<T>& v, cmp_fn<T> cmp) {
 /* Parallel Quick Sort */
 template <class T> void pquick_sort(std::vector<T>& v, cmp_fn<T> cmp);
 
+/*
+ * The parallel quick sorts only fork when the smaller side holds at least
+ * 1 / SORT_FORK_SKEW of the larger one. A more lopsided split sorts its
+ * smaller side in place and goes on with the larger one, which keeps the
+ * forks O(log n) deep on inputs that defeat the pivot.
+ */
+const size_t SORT_FORK_SKEW = 16;
+
+/*
+ * Partitions v[lo, hi) until it splits evenly enough to fork, and returns
+ * false once the range is sorted or the sides given by lo, hi, and p are
+ * ready to be forked.
+ */
+template <class T>
+bool pquick_split(std::vector<T>& v, cmp_fn<T> cmp, size_t& lo, size_t& hi,
+                  std::pair<size_t, size_t>& p, bool random) {
+    while (hi - lo >= sort_tuning().grain && hi - lo > sort_tuning().leaf) {
+        p = partition(v, cmp, lo, hi, choose_pivot(v, cmp, lo, hi, random));
+        size_t a = p.first, b = hi - lo - p.second;
+        if (std::min(a, b) >= std::max(a, b) / SORT_FORK_SKEW)
+            return true;
+        if (a < b) {
+            quick_sort_helper(v, cmp, lo, lo + a, random);
+            lo += p.second;
+        } else {
+            quick_sort_helper(v, cmp, lo + p.second, hi, random);
+            hi = lo + a;
+        }
+    }
+    quick_sort_helper(v, cmp, lo, hi, random);
+    return false;
+}
+
 template <class T>
 void pquick_sort_helper(std::vector<T>& v, cmp_fn<T> cmp,
                         size_t lo, size_t hi) {
-    if (hi - lo <= 1)
+    if (hi - lo < sort_tuning().grain || hi - lo <= sort_tuning().leaf) {
+        quick_sort_helper(v, cmp, lo, hi);
+        return;
+    }
+    SortSpan span("pquick_sort", hi - lo);
+    std::pair<size_t, size_t> p;
+    if (!pquick_split(v, cmp, lo, hi, p, false))
         return;
-    size_t p = partition(v, cmp, lo, hi, lo + (hi - lo) / 2);
-    std::thread head(pquick_sort_helper<T>, std::ref(v), cmp, lo, lo + p);
-    std::thread tail(pquick_sort_helper<T>, std::ref(v), cmp, lo + p + 1, hi);
-    head.join();
-    tail.join();
+    sort_fork([&]() { pquick_sort_helper<T>(v, cmp, lo, lo + p.first); },
+              [&]() { pquick_sort_helper<T>(v, cmp, lo + p.second, hi); },
+              p.first, hi - lo - p.second);
 }
 
 template <class T>
@@ -221,13 +456,17 @@ template <class T> void rpquick_sort(std::vector<T>& v, cmp_fn<T> cmp);
 template <class T>
 void rpquick_sort_helper(std::vector<T>& v, cmp_fn<T> cmp,
                          size_t lo, size_t hi) {
-    if (hi - lo <= 1)
+    if (hi - lo < sort_tuning().grain || hi - lo <= sort_tuning().leaf) {
+        quick_sort_helper(v, cmp, lo, hi, true);
+        return;
+    }
+    SortSpan span("rpquick_sort", hi - lo);
+    std::pair<size_t, size_t> p;
+    if (!pquick_split(v, cmp, lo, hi, p, true))
         return;
-    size_t p = partition(v, cmp, lo, hi, rand() % (hi - lo) + lo);
-    std::thread head(rpquick_sort_helper<T>, std::ref(v), cmp, lo, lo + p);
-    std::thread tail(rpquick_sort_helper<T>, std::ref(v), cmp, lo + p + 1, hi);
-    head.join();
-    tail.join();
+    sort_fork([&]() { rpquick_sort_helper<T>(v, cmp, lo, lo + p.first); },
+              [&]() { rpquick_sort_helper<T>(v, cmp, lo + p.second, hi); },
+              p.first, hi - lo - p.second);
 }
 
 template <class T>
@@ -239,7 +478,716 @@ void rpquick_sort(std::vector<T>& v, cmp_fn<T> cmp) {
 /* std::sort */
 template <class T>
 void std_sort(std::vector<T>& v, cmp_fn<T> cmp) {
-    std::sort(v.begin(), v.end(), cmp);
+    // x <= y is not a strict weak order, on which std::sort may run past
+    // the range when elements repeat
+    std::sort(v.begin(), v.end(), [&](T& x, T& y) { return !cmp(y, x); });
+}
+
+
+/* Counting Sort and Radix Sort */
+template <class T> void counting_sort(std::vector<T>& v, cmp_fn<T> cmp);
+template <class T> void radix_sort(std::vector<T>& v, cmp_fn<T> cmp);
+
+/* Most key values per element that counting sort counts */
+const size_t SORT_COUNTING_SPREAD = 4;
+
+/* Smallest and largest key of v */
+template <class T>
+void key_range(std::vector<T>& v, int64_t& lo, int64_t& hi) {
+    lo = hi = v.empty() ? 0 : SortKey<T>::key(v[0]);
+    for (T& x : v) {
+        int64_t k = SortKey<T>::key(x);
+        lo = std::min(lo, k);
+        hi = std::max(hi, k);
+    }
+}
+
+/*
+ * Offset of the key of x from the first key in the given order, where the
+ * keys of v lie in [lo, hi]
+ */
+template <class T>
+uint64_t key_offset(const T& x, int order, int64_t lo, int64_t hi) {
+    uint64_t k = (uint64_t)SortKey<T>::key(x);
+    return order > 0 ? k - (uint64_t)lo : (uint64_t)hi - k;
+}
+
+/* Stably moves src into dst ordered by digit(x), which is below buckets */
+template <class T, class D>
+void distribute(std::vector<T>& src, std::vector<T>& dst, size_t buckets,
+                D digit) {
+    std::vector<size_t> start(buckets + 1, 0);
+    for (T& x : src)
+        start[digit(x) + 1]++;
+    for (size_t b = 0; b < buckets; b++)
+        start[b + 1] += start[b];
+    for (T& x : src)
+        dst[start[digit(x)]++] = x;
+}
+
+/* Counting sort of v, whose keys lie in [lo, hi], in the given order */
+template <class T>
+void counting_sort_keys(std::vector<T>& v, int order, int64_t lo, int64_t hi) {
+    SortSpan span("counting_sort", v.size());
+    std::vector<T> u(v.size());
+    SortScratch scratch(u);
+    size_t buckets = (size_t)((uint64_t)hi - (uint64_t)lo) + 1;
+    distribute(v, u, buckets, [&](const T& x) {
+        return (size_t)key_offset(x, order, lo, hi);
+    });
+    std::copy(u.begin(), u.end(), v.begin());
+}
+
+/*
+ * LSD radix sort of v, whose keys lie in [lo, hi], in the given order: one
+ * pass per digit of sort_tuning().radix_bits bits of the key offsets
+ */
+template <class T>
+void radix_sort_keys(std::vector<T>& v, int order, int64_t lo, int64_t hi) {
+    SortSpan span("radix_sort", v.size());
+    uint64_t range = (uint64_t)hi - (uint64_t)lo;
+    unsigned bits  = (unsigned)std::min<size_t>(
+                         std::max<size_t>(sort_tuning().radix_bits, 1), 16);
+    uint64_t mask  = ((uint64_t)1 << bits) - 1;
+    std::vector<T> u(v.size());
+    SortScratch scratch(u);
+    std::vector<T>* src = &v;
+    std::vector<T>* dst = &u;
+    for (unsigned shift = 0; shift < 64 && (range >> shift); shift += bits) {
+        distribute(*src, *dst, (size_t)1 << bits, [&](const T& x) {
+            return (size_t)((key_offset(x, order, lo, hi) >> shift) & mask);
+        });
+        std::swap(src, dst);
+    }
+    if (src != &v)
+        std::copy(u.begin(), u.end(), v.begin());
+}
+
+/*
+ * Both sort by SortKey in the order of cmp, and fall back to merge sort if
+ * cmp does not order by key. Counting sort leaves to radix sort when the
+ * keys span more than SORT_COUNTING_SPREAD values per element.
+ */
+template <class T>
+void counting_sort(std::vector<T>& v, cmp_fn<T> cmp) {
+    int order = sort_key_order(v, cmp);
+    if (!order) {
+        merge_sort(v, cmp);
+        return;
+    }
+    if (v.size() <= 1)
+        return;
+    int64_t lo, hi;
+    key_range(v, lo, hi);
+    if ((uint64_t)hi - (uint64_t)lo >= SORT_COUNTING_SPREAD * v.size())
+        radix_sort_keys(v, order, lo, hi);
+    else
+        counting_sort_keys(v, order, lo, hi);
+}
+
+template <class T>
+void radix_sort(std::vector<T>& v, cmp_fn<T> cmp) {
+    int order = sort_key_order(v, cmp);
+    if (!order) {
+        merge_sort(v, cmp);
+        return;
+    }
+    if (v.size() <= 1)
+        return;
+    int64_t lo, hi;
+    key_range(v, lo, hi);
+    radix_sort_keys(v, order, lo, hi);
+}
+
+
+/* Natural Merge Sort */
+template <class T> void natural_merge_sort(std::vector<T>& v, cmp_fn<T> cmp);
+
+/*
+ * Splits v into its ascending runs, reversing strictly descending ones and
+ * extending runs shorter than the leaf size by insertion sort, then merges
+ * neighbouring runs until one is left. Sorted and reversed inputs take one
+ * pass, and the sort is stable.
+ */
+template <class T>
+void natural_merge_sort(std::vector<T>& v, cmp_fn<T> cmp) {
+    size_t n = v.size();
+    if (n <= 1)
+        return;
+    SortSpan span("natural_merge_sort", n);
+    std::vector<size_t> bounds(1, 0);
+    size_t lo = 0;
+    while (lo < n) {
+        size_t hi = lo + 1;
+        if (hi < n && !cmp(v[lo], v[hi])) {
+            while (hi < n && !cmp(v[hi - 1], v[hi]))
+                hi++;
+            for (size_t i = lo, j = hi - 1; i < j; i++, j--)
+                sort_swap(v[i], v[j]);
+        } else {
+            while (hi < n && cmp(v[hi - 1], v[hi]))
+                hi++;
+        }
+        if (hi - lo < sort_tuning().leaf) {
+            hi = std::min(n, lo + sort_tuning().leaf);
+            insertion_sort_range(v, cmp, lo, hi);
+        }
+        bounds.push_back(hi);
+        lo = hi;
+    }
+    while (bounds.size() > 2) {
+        std::vector<size_t> next(1, 0);
+        for (size_t k = 0; k + 1 < bounds.size(); k += 2) {
+            if (k + 2 < bounds.size()) {
+                merge_runs(v, cmp, bounds[k], bounds[k + 1], bounds[k + 2]);
+                next.push_back(bounds[k + 2]);
+            } else {
+                next.push_back(bounds[k + 1]);
+            }
+        }
+        bounds.swap(next);
+    }
+}
+
+
+/* Pattern-Defeating Quicksort */
+template <class T> void pdq_sort(std::vector<T>& v, cmp_fn<T> cmp);
+
+/*
+ * Orson Peters' pdqsort, on comparisons less(x, y) = !cmp(y, x), which is
+ * x < y for the x <= y comparators used here. Every scan is bounds checked,
+ * so a comparator that is not a strict order cannot run past the range.
+ */
+const size_t SORT_PDQ_INSERTION = 24;
+const size_t SORT_PDQ_NINTHER   = 128;
+const size_t SORT_PDQ_MOVES     = 8;
+
+template <class T>
+bool sort_less(cmp_fn<T>& cmp, T& x, T& y) {
+    return !cmp(y, x);
+}
+
+/* Orders v[a] and v[b] */
+template <class T>
+void sort2(std::vector<T>& v, cmp_fn<T>& cmp, size_t a, size_t b) {
+    if (sort_less(cmp, v[b], v[a]))
+        sort_swap(v[a], v[b]);
+}
+
+/* Orders v[a], v[b], and v[c], leaving the median in v[b] */
+template <class T>
+void sort3(std::vector<T>& v, cmp_fn<T>& cmp, size_t a, size_t b, size_t c) {
+    sort2(v, cmp, a, b);
+    sort2(v, cmp, b, c);
+    sort2(v, cmp, a, b);
+}
+
+/* Heap sort of v[lo, hi), the fallback of pdqsort on bad pivots */
+template <class T>
+void heap_sort_range(std::vector<T>& v, cmp_fn<T>& cmp, size_t lo, size_t hi) {
+    size_t n = hi - lo;
+    auto sift = [&](size_t i, size_t m) {
+        while (2 * i + 1 < m) {
+            size_t c = 2 * i + 1;
+            if (c + 1 < m && sort_less(cmp, v[lo + c], v[lo + c + 1]))
+                c++;
+            if (!sort_less(cmp, v[lo + i], v[lo + c]))
+                return;
+            sort_swap(v[lo + i], v[lo + c]);
+            i = c;
+        }
+    };
+    for (size_t i = n / 2; i-- > 0;)
+        sift(i, n);
+    for (size_t m = n; m-- > 1;) {
+        sort_swap(v[lo], v[lo + m]);
+        sift(0, m);
+    }
+}
+
+/*
+ * Insertion sort of v[lo, hi) that gives up after SORT_PDQ_MOVES moves.
+ * Returns whether it finished.
+ */
+template <class T>
+bool partial_insertion_sort(std::vector<T>& v, cmp_fn<T>& cmp,
+                            size_t lo, size_t hi) {
+    size_t moves = 0;
+    for (size_t i = lo + 1; i < hi; i++) {
+        if (!sort_less(cmp, v[i], v[i - 1]))
+            continue;
+        T temp = v[i];
+        size_t j = i;
+        do {
+            v[j] = v[j - 1];
+            j--;
+        } while (j > lo && sort_less(cmp, temp, v[j - 1]));
+        v[j] = temp;
+        moves += i - j;
+        if (moves > SORT_PDQ_MOVES)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Partitions v[lo, hi) around the pivot v[lo]: smaller elements to its
+ * left, the others to its right. Returns where the pivot ends up, and tells
+ * whether no element had to move.
+ */
+template <class T>
+size_t partition_right(std::vector<T>& v, cmp_fn<T>& cmp,
+                       size_t lo, size_t hi, bool& already) {
+    SortSpan span("partition", hi - lo);
+    T pivot = v[lo];
+    size_t first = lo + 1, last = hi;
+    while (first < last && sort_less(cmp, v[first], pivot))
+        first++;
+    while (first < last && !sort_less(cmp, v[last - 1], pivot))
+        last--;
+    already = first >= last;
+    while (first < last) {
+        sort_swap(v[first], v[last - 1]);
+        first++;
+        last--;
+        while (first < last && sort_less(cmp, v[first], pivot))
+            first++;
+        while (first < last && !sort_less(cmp, v[last - 1], pivot))
+            last--;
+    }
+    sort_swap(v[lo], v[first - 1]);
+    return first - 1;
+}
+
+/*
+ * Partitions v[lo, hi) around the pivot v[lo] with the elements equal to
+ * it on its left, for ranges with no smaller element. Returns where the
+ * pivot ends up.
+ */
+template <class T>
+size_t partition_left(std::vector<T>& v, cmp_fn<T>& cmp,
+                      size_t lo, size_t hi) {
+    SortSpan span("partition", hi - lo);
+    T pivot = v[lo];
+    size_t first = lo + 1, last = hi;
+    while (first < last && !sort_less(cmp, pivot, v[first]))
+        first++;
+    while (first < last && sort_less(cmp, pivot, v[last - 1]))
+        last--;
+    while (first < last) {
+        sort_swap(v[first], v[last - 1]);
+        first++;
+        last--;
+        while (first < last && !sort_less(cmp, pivot, v[first]))
+            first++;
+        while (first < last && sort_less(cmp, pivot, v[last - 1]))
+            last--;
+    }
+    sort_swap(v[lo], v[first - 1]);
+    return first - 1;
+}
+
+template <class T>
+void pdq_sort_helper(std::vector<T>& v, cmp_fn<T>& cmp, size_t lo, size_t hi,
+                     int bad, bool leftmost) {
+    while (hi - lo > SORT_PDQ_INSERTION) {
+        size_t n = hi - lo, mid = lo + n / 2;
+        SortSpan span("pdq_sort", n);
+
+        // Pivot: median of three, or pseudomedian of nine on long ranges
+        if (n > SORT_PDQ_NINTHER) {
+            sort3(v, cmp, lo, mid, hi - 1);
+            sort3(v, cmp, lo + 1, mid - 1, hi - 2);
+            sort3(v, cmp, lo + 2, mid + 1, hi - 3);
+            sort3(v, cmp, mid - 1, mid, mid + 1);
+            sort_swap(v[lo], v[mid]);
+        } else {
+            sort3(v, cmp, mid, lo, hi - 1);
+        }
+
+        // A pivot equal to the one before the range is its smallest
+        // element, so set aside every element equal to it
+        if (!leftmost && !sort_less(cmp, v[lo - 1], v[lo])) {
+            lo = partition_left(v, cmp, lo, hi) + 1;
+            continue;
+        }
+
+        bool already;
+        size_t p = partition_right(v, cmp, lo, hi, already);
+        size_t l = p - lo, r = hi - p - 1;
+        if (l < n / 8 || r < n / 8) {
+            // Unbalanced: after too many, switch to heap sort, else break
+            // up the pattern that caused it
+            if (--bad == 0) {
+                heap_sort_range(v, cmp, lo, hi);
+                return;
+            }
+            if (l >= SORT_PDQ_INSERTION) {
+                sort_swap(v[lo], v[lo + l / 4]);
+                sort_swap(v[p - 1], v[p - l / 4]);
+            }
+            if (r >= SORT_PDQ_INSERTION) {
+                sort_swap(v[p + 1], v[p + 1 + r / 4]);
+                sort_swap(v[hi - 1], v[hi - r / 4]);
+            }
+        } else if (already && partial_insertion_sort(v, cmp, lo, p)
+                   && partial_insertion_sort(v, cmp, p + 1, hi)) {
+            return;
+        }
+        pdq_sort_helper(v, cmp, lo, p, bad, leftmost);
+        lo = p + 1;
+        leftmost = false;
+    }
+    insertion_sort_range(v, cmp, lo, hi);
+}
+
+/* pdqsort of v[lo, hi) */
+template <class T>
+void pdq_sort_range(std::vector<T>& v, cmp_fn<T>& cmp, size_t lo, size_t hi) {
+    int bad = 1;
+    for (size_t n = hi - lo; n > 1; n >>= 1)
+        bad++;
+    pdq_sort_helper(v, cmp, lo, hi, bad, true);
+}
+
+template <class T>
+void pdq_sort(std::vector<T>& v, cmp_fn<T> cmp) {
+    pdq_sort_range(v, cmp, 0, v.size());
+}
+
+
+/* Merge Insertion (Ford-Johnson) */
+template <class T> void merge_insertion_sort(std::vector<T>& v, cmp_fn<T> cmp);
+
+/*
+ * Sorts the indices idx of elements of v with close to the fewest
+ * comparisons possible: the pairs are ordered, their larger elements sorted
+ * recursively, and the smaller ones binary inserted in the order of the
+ * Jacobsthal numbers, so that each search spans just under a power of two.
+ */
+template <class T>
+void merge_insertion_order(std::vector<T>& v, cmp_fn<T>& cmp,
+                           std::vector<size_t>& idx) {
+    size_t n = idx.size(), m = n / 2;
+    if (n < 2)
+        return;
+    std::vector<std::pair<size_t, size_t>> pairs(m);    // (larger, smaller)
+    std::vector<size_t> big(m);
+    for (size_t i = 0; i < m; i++) {
+        size_t a = idx[2 * i], b = idx[2 * i + 1];
+        pairs[i] = sort_less(cmp, v[b], v[a]) ? std::make_pair(a, b)
+                                              : std::make_pair(b, a);
+        big[i] = pairs[i].first;
+    }
+    merge_insertion_order(v, cmp, big);
+    std::sort(pairs.begin(), pairs.end());
+    auto partner = [&](size_t x) {
+        return std::lower_bound(pairs.begin(), pairs.end(),
+                                std::make_pair(x, (size_t)0))->second;
+    };
+
+    // Smaller element k goes before big[k] (the leftover one, k = m, last)
+    std::vector<size_t> chain;
+    chain.reserve(n);
+    chain.push_back(partner(big[0]));
+    chain.insert(chain.end(), big.begin(), big.end());
+    size_t pend = m + n % 2;
+    auto insert = [&](size_t k) {
+        size_t x  = k < m ? partner(big[k]) : idx[n - 1];
+        size_t lo = 0, hi = chain.size();
+        if (k < m)
+            hi = std::find(chain.begin(), chain.end(), big[k]) - chain.begin();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (sort_less(cmp, v[x], v[chain[mid]]))
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        chain.insert(chain.begin() + lo, x);
+    };
+    for (size_t t0 = 1, t1 = 1; t1 < pend; ) {
+        size_t t2 = t1 + 2 * t0;
+        for (size_t k = std::min(t2, pend); k > t1; k--)
+            insert(k - 1);
+        t0 = t1;
+        t1 = t2;
+    }
+    idx.swap(chain);
+}
+
+template <class T>
+void merge_insertion_sort(std::vector<T>& v, cmp_fn<T> cmp) {
+    SortSpan span("merge_insertion_sort", v.size());
+    std::vector<size_t> idx(v.size());
+    for (size_t i = 0; i < idx.size(); i++)
+        idx[i] = i;
+    merge_insertion_order(v, cmp, idx);
+
+    // Only the final permutation moves elements
+    std::vector<T> u(v.size());
+    SortScratch scratch(u);
+    for (size_t k = 0; k < idx.size(); k++)
+        u[k] = v[idx[k]];
+    for (size_t i = 0; i < v.size(); i++)
+        v[i] = u[i];
+}
+
+
+/* Cycle Sort */
+template <class T> void cycle_sort(std::vector<T>& v, cmp_fn<T> cmp);
+
+/*
+ * Writes every element of v at most once, straight to its place: the
+ * position of an element is the number of elements less than it, and the
+ * element it displaces is placed next until the cycle closes. Quadratic in
+ * comparisons, for elements that are far more expensive to write than to
+ * compare.
+ */
+template <class T>
+size_t cycle_place(std::vector<T>& v, cmp_fn<T>& cmp, T& item,
+                   size_t start) {
+    size_t pos = start;
+    for (size_t i = start + 1; i < v.size(); i++)
+        if (sort_less(cmp, v[i], item))
+            pos++;
+    if (pos == start)
+        return pos;
+    // Past the copies of item that are already in place
+    while (pos < v.size() && cmp(item, v[pos]) && cmp(v[pos], item))
+        pos++;
+    return pos;
+}
+
+template <class T>
+void cycle_sort(std::vector<T>& v, cmp_fn<T> cmp) {
+    SortSpan span("cycle_sort", v.size());
+    for (size_t start = 0; start + 1 < v.size(); start++) {
+        T item = v[start];
+        size_t pos = cycle_place(v, cmp, item, start);
+        if (pos == start || pos == v.size())
+            continue;
+        sort_swap(item, v[pos]);
+        while (pos != start) {
+            pos = cycle_place(v, cmp, item, start);
+            if (pos == v.size()) {
+                v[start] = item;
+                break;
+            }
+            sort_swap(item, v[pos]);
+        }
+    }
+}
+
+
+/* Parallel Samplesort */
+template <class T> void psample_sort(std::vector<T>& v, cmp_fn<T> cmp);
+
+/* Fewest elements worth a samplesort, and samples taken per bucket */
+const size_t SORT_SAMPLE_MIN  = 4096;
+const size_t SORT_OVERSAMPLE  = 8;
+
+/* Threads a parallel sort may use: the thread limit, else the cores */
+inline unsigned sort_threads_available() {
+    unsigned limit = sort_thread_limit();
+    return limit ? limit : std::max(1u, std::thread::hardware_concurrency());
+}
+
+/*
+ * Runs f(i) for every i in [lo, hi) through sort_fork(), where item i
+ * covers the elements bounds[i] to bounds[i + 1]
+ */
+template <class F>
+void sort_parallel_for(size_t lo, size_t hi, const std::vector<size_t>& bounds,
+                       F& f) {
+    if (hi - lo == 1) {
+        f(lo);
+        return;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    sort_fork([&]() { sort_parallel_for(lo, mid, bounds, f); },
+              [&]() { sort_parallel_for(mid, hi, bounds, f); },
+              bounds[mid] - bounds[lo], bounds[hi] - bounds[mid]);
+}
+
+/*
+ * Picks splitters from a sorted sample, puts every element in the bucket
+ * between two splitters (one chunk of the input per thread), and pdqsorts
+ * the buckets in parallel. Falls back to pdqsort with a single thread or
+ * below SORT_SAMPLE_MIN elements (or the grain size).
+ */
+template <class T>
+void psample_sort(std::vector<T>& v, cmp_fn<T> cmp) {
+    size_t n = v.size();
+    unsigned threads = sort_threads_available();
+    if (threads <= 1 || n < std::max(SORT_SAMPLE_MIN, sort_tuning().grain)) {
+        pdq_sort(v, cmp);
+        return;
+    }
+    SortSpan span("psample_sort", n);
+    size_t buckets = std::min<size_t>(4 * threads, n / 1024);
+    size_t chunks  = threads;
+
+    std::vector<T> sample;
+    size_t s = buckets * SORT_OVERSAMPLE;
+    for (size_t i = 0; i < s; i++)
+        sample.push_back(v[(2 * i + 1) * n / (2 * s)]);
+    pdq_sort(sample, cmp);
+    std::vector<T> split;
+    for (size_t b = 1; b < buckets; b++)
+        split.push_back(sample[b * SORT_OVERSAMPLE]);
+
+    // Bucket of every element, and the bucket sizes of every chunk
+    std::vector<size_t> chunk(chunks + 1);
+    for (size_t c = 0; c <= chunks; c++)
+        chunk[c] = c * n / chunks;
+    std::vector<uint32_t> id(n);
+    std::vector<size_t> at(chunks * buckets, 0);
+    auto classify = [&](size_t c) {
+        for (size_t i = chunk[c]; i < chunk[c + 1]; i++) {
+            size_t a = 0, b = split.size();
+            while (a < b) {
+                size_t m = a + (b - a) / 2;
+                if (sort_less(cmp, v[i], split[m]))
+                    b = m;
+                else
+                    a = m + 1;
+            }
+            id[i] = (uint32_t)a;
+            at[c * buckets + a]++;
+        }
+    };
+    sort_parallel_for(0, chunks, chunk, classify);
+
+    // Where the share of every chunk in every bucket goes
+    std::vector<size_t> bucket(buckets + 1, n);
+    size_t next = 0;
+    for (size_t b = 0; b < buckets; b++) {
+        bucket[b] = next;
+        for (size_t c = 0; c < chunks; c++) {
+            size_t k = at[c * buckets + b];
+            at[c * buckets + b] = next;
+            next += k;
+        }
+    }
+
+    std::vector<T> u(n);
+    SortScratch scratch(u);
+    auto scatter = [&](size_t c) {
+        for (size_t i = chunk[c]; i < chunk[c + 1]; i++)
+            u[at[c * buckets + id[i]]++] = v[i];
+    };
+    sort_parallel_for(0, chunks, chunk, scatter);
+    auto finish = [&](size_t b) {
+        pdq_sort_range(u, cmp, bucket[b], bucket[b + 1]);
+        std::copy(u.begin() + bucket[b], u.begin() + bucket[b + 1],
+                  v.begin() + bucket[b]);
+    };
+    sort_parallel_for(0, buckets, bucket, finish);
+}
+
+
+/* Adaptive Sort */
+template <class T> void auto_sort(std::vector<T>& v, cmp_fn<T> cmp);
+
+/*
+ * Most elements auto_sort() insertion sorts, most runs it merges, and the
+ * adjacent pairs and elements it samples
+ */
+const size_t SORT_AUTO_SMALL = 32;
+const size_t SORT_AUTO_RUNS  = 4;
+const size_t SORT_AUTO_PAIRS = 128;
+const size_t SORT_AUTO_DUPS  = 64;
+
+/*
+ * Samples v: the share of adjacent pairs in order, the share of equal
+ * elements, and the keys if cmp orders by them. If no sampled pair is out
+ * of order (or none in order), also counts the runs of v, up to one more
+ * than SORT_AUTO_RUNS.
+ */
+template <class T>
+SortChoice auto_probe(std::vector<T>& v, cmp_fn<T>& cmp) {
+    SortChoice c;
+    size_t n = v.size();
+    c.n         = n;
+    c.elem_size = sizeof(T);
+    c.threads   = sort_threads_available();
+    if (n < 2)
+        return c;
+
+    size_t m = std::min(n - 1, SORT_AUTO_PAIRS), in_order = 0;
+    for (size_t k = 0; k < m; k++) {
+        size_t i = 1 + k * (n - 1) / m;
+        in_order += cmp(v[i - 1], v[i]);
+    }
+    c.sorted = (double)in_order / m;
+    if (c.sorted == 1.0 || c.sorted == 0.0) {
+        c.runs = 1;
+        bool up = c.sorted == 1.0;
+        for (size_t i = 1; i < n && c.runs <= SORT_AUTO_RUNS; i++)
+            if (cmp(v[i - 1], v[i]) != up) {
+                c.runs++;
+                up = !up;
+            }
+    }
+
+    std::vector<T> sample;
+    m = std::min(n, SORT_AUTO_DUPS);
+    for (size_t k = 0; k < m; k++)
+        sample.push_back(v[k * n / m]);
+    pdq_sort(sample, cmp);
+    size_t equal = 0;
+    for (size_t k = 1; k < m; k++)
+        equal += !sort_less(cmp, sample[k - 1], sample[k]);
+    c.dups = (double)equal / m;
+
+    c.key_order = sort_key_order(v, cmp);
+    if (c.key_order)
+        key_range(sample, c.key_lo, c.key_hi);
+    return c;
+}
+
+/*
+ * Probes v (see auto_probe()) and runs the sort that suits it:
+ *      - insertion sort on a handful of elements
+ *      - natural merge sort if v has at most SORT_AUTO_RUNS runs
+ *      - counting sort if cmp orders by key and the sampled keys span few
+ *        values per element
+ *      - parallel samplesort if there are threads, enough elements, and
+ *        few duplicates to unbalance its buckets
+ *      - radix sort if cmp orders by key
+ *      - pdqsort otherwise
+ * The probe and the choice are recorded in the bound run (see SortChoice).
+ */
+template <class T>
+void auto_sort(std::vector<T>& v, cmp_fn<T> cmp) {
+    SortChoice c = auto_probe(v, cmp);
+    size_t n = v.size();
+    uint64_t spread = (uint64_t)c.key_hi - (uint64_t)c.key_lo;
+    sort_fn<T> sort = pdq_sort<T>;
+    c.engine = "pdq";
+    if (n <= SORT_AUTO_SMALL) {
+        sort = [](std::vector<T>& u, cmp_fn<T> f) {
+            insertion_sort_range(u, f, 0, u.size());
+        };
+        c.engine = "insertion";
+    } else if (c.runs && c.runs <= SORT_AUTO_RUNS) {
+        sort = natural_merge_sort<T>;
+        c.engine = "natural_merge";
+    } else if (c.key_order && spread < SORT_COUNTING_SPREAD * n) {
+        sort = counting_sort<T>;
+        c.engine = "counting";
+    } else if (c.threads > 1 && c.dups < 0.5
+               && n >= std::max(SORT_SAMPLE_MIN * c.threads,
+                                sort_tuning().grain)) {
+        sort = psample_sort<T>;
+        c.engine = "psample";
+    } else if (c.key_order) {
+        sort = radix_sort<T>;
+        c.engine = "radix";
+    }
+    sort_note_choice(c);
+    sort(v, cmp);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,91 @@
+/**
+ * @file  sorting_alloc.cpp
+ * @brief Heap hooks counting the allocations of each sort run
+ *
+ * Replaces the global operator new and delete so that every allocation made
+ * by a thread bound to a run (see sort_bind) is counted in the run's heap
+ * statistics (see SortHeap): calls, bytes, the peak of the bytes still
+ * allocated, and which worker threads allocated. Link this file into the
+ * animator or the benchmark to enable the counts; without it they stay zero
+ * and sort_heap_hooked() is false.
+ *
+ * Each block is preceded by a small header holding its size, so that a
+ * delete knows how many bytes it releases. Blocks are released to the run
+ * of the thread that deletes them, which is the run that allocated them in
+ * every sort of sorting.h.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#include "sorting_stats.h"
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+
+
+/** @brief Room before each block for its size, keeping blocks aligned */
+static const size_t HEAP_HEADER = alignof(std::max_align_t);
+
+static const bool heap_hooked = (sort_heap_hooked() = true);
+
+/** @brief Allocates a block of n bytes and counts it (NULL on failure) */
+static void* heap_alloc(size_t n) {
+    char* p = (char*)malloc(n + HEAP_HEADER);
+    if (!p)
+        return NULL;
+    *(size_t*)p = n;
+    sort_count_heap((int64_t)n);
+    return p + HEAP_HEADER;
+}
+
+/** @brief Releases a block from heap_alloc() and counts it */
+static void heap_free(void* q) {
+    if (!q)
+        return;
+    char* p = (char*)q - HEAP_HEADER;
+    sort_count_heap(-(int64_t)*(size_t*)p);
+    free(p);
+}
+
+void* operator new(size_t n) {
+    void* p = heap_alloc(n);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t n) {
+    return operator new(n);
+}
+
+void* operator new(size_t n, const std::nothrow_t&) noexcept {
+    return heap_alloc(n);
+}
+
+void* operator new[](size_t n, const std::nothrow_t&) noexcept {
+    return heap_alloc(n);
+}
+
+void operator delete(void* p) noexcept {
+    heap_free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    heap_free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    heap_free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    heap_free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    heap_free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    heap_free(p);
+}
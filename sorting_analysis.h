@@ -0,0 +1,405 @@
+/**
+ * @file  sorting_analysis.h
+ * @brief Measures of how far a sequence is from being sorted
+ *
+ * Defines an inversion tracker that follows the writes made by a sort and
+ * keeps the number of inversions and ascending runs of the sequence up to
+ * date. Positions are split into blocks of about sqrt(n) elements, each with
+ * a Fenwick tree over the values it holds, so a write costs O(sqrt(n) log n)
+ * instead of a full recount.
+ *
+ * Also computes the classic measures of disorder of a whole sequence at
+ * once (see Disorder), to relate the cost of a sort to its input:
+ * ascending runs, inversions, Rem, Max, Osc, and the share of duplicates.
+ *
+ * Finally, multiset_hash() tells whether the output of a sort is still a
+ * permutation of its input without sorting a copy to compare with.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#ifndef __SORTING_ANALYSIS_H__
+#define __SORTING_ANALYSIS_H__
+
+#include "sorting_stats.h"
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+
+
+/** @brief Fenwick (binary indexed) tree of counts over [0, n) */
+class FenwickTree {
+public:
+    FenwickTree(size_t n = 0) : tree(n + 1, 0) {}
+
+    /** @brief Adds d to the count at i */
+    void add(size_t i, int64_t d) {
+        for (i++; i < tree.size(); i += i & (~i + 1))
+            tree[i] += d;
+    }
+
+    /** @brief Sum of the counts in [0, i) */
+    int64_t prefix(size_t i) const {
+        int64_t s = 0;
+        for (i = std::min(i, tree.size() - 1); i > 0; i -= i & (~i + 1))
+            s += tree[i];
+        return s;
+    }
+
+private:
+    std::vector<int64_t> tree;
+};
+
+/**
+ * @brief Number of inversions of a sequence in O(n log n)
+ *
+ * @pre Every value lies in [lo, hi]
+ */
+inline uint64_t count_inversions(const std::vector<int>& a, int lo, int hi) {
+    FenwickTree seen(hi - lo + 1);
+    uint64_t inv = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        inv += i - seen.prefix(a[i] - lo + 1);
+        seen.add(a[i] - lo, 1);
+    }
+    return inv;
+}
+
+/**
+ * @brief Inversion and run counts of a sequence under single-element writes
+ *
+ * Thread safe: parallel sorts may report writes concurrently.
+ */
+class InversionTracker {
+public:
+    InversionTracker() : n(0), block(1), lo(0), hi(0), inv(0), descents(0) {}
+
+    /** @brief Starts tracking a sequence */
+    void reset(const std::vector<int>& values) {
+        std::lock_guard<std::mutex> lock(m);
+        a  = values;
+        n  = a.size();
+        lo = n ? *std::min_element(a.begin(), a.end()) : 0;
+        hi = n ? *std::max_element(a.begin(), a.end()) : 0;
+        block = std::max<size_t>(1, (size_t)std::sqrt((double)n));
+        blocks.assign((n + block - 1) / block, FenwickTree(hi - lo + 1));
+        for (size_t i = 0; i < n; i++)
+            blocks[i / block].add(a[i] - lo, 1);
+        inv = count_inversions(a, lo, hi);
+        descents = 0;
+        for (size_t i = 1; i < n; i++)
+            descents += a[i - 1] > a[i];
+    }
+
+    /**
+     * @brief Records that position p now holds value x
+     *
+     * @pre x lies within the range of the values given to reset()
+     */
+    void update(size_t p, int x) {
+        std::lock_guard<std::mutex> lock(m);
+        if (p >= n || x == a[p] || x < lo || x > hi)
+            return;
+        int y = a[p];
+        inv -= count(0, p, y + 1, hi) + count(p + 1, n, lo, y - 1);
+        inv += count(0, p, x + 1, hi) + count(p + 1, n, lo, x - 1);
+        descents -= local_descents(p);
+        blocks[p / block].add(y - lo, -1);
+        blocks[p / block].add(x - lo, 1);
+        a[p] = x;
+        descents += local_descents(p);
+    }
+
+    /** @brief Current number of inversions */
+    uint64_t inversions() {
+        std::lock_guard<std::mutex> lock(m);
+        return inv;
+    }
+
+    /** @brief Number of inversions of the sequence in reverse order */
+    uint64_t max_inversions() {
+        std::lock_guard<std::mutex> lock(m);
+        return n > 1 ? (uint64_t)n * (n - 1) / 2 : 0;
+    }
+
+    /** @brief Current number of maximal ascending runs */
+    size_t runs() {
+        std::lock_guard<std::mutex> lock(m);
+        return n ? descents + 1 : 0;
+    }
+
+private:
+    std::mutex m;
+
+    /** @brief Shadow copy of the tracked sequence */
+    std::vector<int> a;
+
+    /** @brief Length of the sequence and positions per block */
+    size_t n, block;
+
+    /** @brief Smallest and largest value of the sequence */
+    int lo, hi;
+
+    /** @brief Value counts of each block of positions */
+    std::vector<FenwickTree> blocks;
+
+    int64_t inv;
+    size_t  descents;
+
+    /** @brief Number of positions in [i, j) holding a value in [x, y] */
+    int64_t count(size_t i, size_t j, int x, int y) const {
+        if (i >= j || x > y)
+            return 0;
+        int64_t c = 0;
+        while (i < j && i % block) {
+            c += in_range(a[i], x, y);
+            i++;
+        }
+        while (i + block <= j) {
+            const FenwickTree& t = blocks[i / block];
+            c += t.prefix(y - lo + 1) - t.prefix(x - lo);
+            i += block;
+        }
+        for (; i < j; i++)
+            c += in_range(a[i], x, y);
+        return c;
+    }
+
+    static bool in_range(int v, int x, int y) {
+        return x <= v && v <= y;
+    }
+
+    /** @brief Descents between p and its neighbours */
+    size_t local_descents(size_t p) const {
+        return (p > 0 && a[p - 1] > a[p]) + (p + 1 < n && a[p] > a[p + 1]);
+    }
+};
+
+
+/***** Measures of Disorder *****/
+
+/**
+ * @brief Sorts a[lo, hi) through buf, returning its number of inversions
+ *
+ * The halves are counted on a thread of their own for depth more levels.
+ */
+inline uint64_t merge_count(std::vector<int>& a, std::vector<int>& buf,
+                            size_t lo, size_t hi, int depth) {
+    if (hi - lo <= 1)
+        return 0;
+    size_t mid = lo + (hi - lo) / 2;
+    uint64_t left, right;
+    if (depth > 0) {
+        std::thread t([&]() {
+            left = merge_count(a, buf, lo, mid, depth - 1);
+        });
+        right = merge_count(a, buf, mid, hi, depth - 1);
+        t.join();
+    } else {
+        left  = merge_count(a, buf, lo, mid, 0);
+        right = merge_count(a, buf, mid, hi, 0);
+    }
+    uint64_t inv = left + right;
+    size_t i = lo, j = mid, k = lo;
+    while (i < mid && j < hi) {
+        if (a[j] < a[i]) {
+            inv += mid - i;
+            buf[k++] = a[j++];
+        } else {
+            buf[k++] = a[i++];
+        }
+    }
+    while (i < mid)
+        buf[k++] = a[i++];
+    while (j < hi)
+        buf[k++] = a[j++];
+    std::copy(buf.begin() + lo, buf.begin() + hi, a.begin() + lo);
+    return inv;
+}
+
+/**
+ * @brief Number of inversions of a sequence by merge sort, on up to the
+ *        given number of threads
+ */
+inline uint64_t count_inversions_merge(std::vector<int> a,
+                                       unsigned threads) {
+    std::vector<int> buf(a.size());
+    int depth = 0;
+    while ((2u << depth) <= threads && (a.size() >> depth) > 4096)
+        depth++;
+    return merge_count(a, buf, 0, a.size(), depth);
+}
+
+/** @brief Measures of how far a sequence is from ascending order */
+struct Disorder {
+    size_t n;
+
+    /** @brief Maximal non-descending runs */
+    size_t runs;
+
+    /** @brief Pairs out of order */
+    uint64_t inversions;
+
+    /** @brief Fewest elements to remove to leave a sorted sequence */
+    size_t rem;
+
+    /** @brief Farthest any element is from its place in sorted order */
+    size_t max;
+
+    /**
+     * @brief Oscillation: over every element, the number of adjacent pairs
+     *        whose values it lies strictly between
+     */
+    uint64_t osc;
+
+    /** @brief Share of the elements equal to an earlier one */
+    double dups;
+
+    Disorder() : n(0), runs(0), inversions(0), rem(0), max(0), osc(0),
+                 dups(0.0) {}
+};
+
+/**
+ * @brief Measures the disorder of a sequence in O(n log n)
+ *
+ * @param[in] threads  Threads counting the inversions (0 for the cores)
+ */
+inline Disorder measure_disorder(const std::vector<int>& a,
+                                 unsigned threads = 0) {
+    Disorder d;
+    size_t n = a.size();
+    d.n = n;
+    if (!n)
+        return d;
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    d.runs = 1;
+    for (size_t i = 1; i < n; i++)
+        d.runs += a[i - 1] > a[i];
+    d.inversions = count_inversions_merge(a, threads);
+
+    // Rem: n less the longest non-descending subsequence
+    std::vector<int> tails;
+    for (int x : a) {
+        auto it = std::upper_bound(tails.begin(), tails.end(), x);
+        if (it == tails.end())
+            tails.push_back(x);
+        else
+            *it = x;
+    }
+    d.rem = n - tails.size();
+
+    // Max: distance to the place of each element in a stable sort
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t i, size_t j) { return a[i] < a[j]; });
+    for (size_t k = 0; k < n; k++)
+        d.max = std::max(d.max, order[k] > k ? order[k] - k : k - order[k]);
+
+    size_t distinct = 1;
+    for (size_t k = 1; k < n; k++)
+        distinct += a[order[k - 1]] != a[order[k]];
+    d.dups = (double)(n - distinct) / n;
+
+    // Osc: pairs (x, y) with x < v < y are those with x < v, less those
+    // with y <= v, plus those with x = y = v
+    std::vector<int> lows, highs, flats;
+    for (size_t i = 1; i < n; i++) {
+        int x = std::min(a[i - 1], a[i]), y = std::max(a[i - 1], a[i]);
+        lows.push_back(x);
+        highs.push_back(y);
+        if (x == y)
+            flats.push_back(x);
+    }
+    std::sort(lows.begin(), lows.end());
+    std::sort(highs.begin(), highs.end());
+    std::sort(flats.begin(), flats.end());
+    for (int v : a) {
+        auto flat = std::equal_range(flats.begin(), flats.end(), v);
+        d.osc += (std::lower_bound(lows.begin(), lows.end(), v) - lows.begin())
+               - (std::upper_bound(highs.begin(), highs.end(), v)
+                  - highs.begin())
+               + (flat.second - flat.first);
+    }
+    return d;
+}
+
+/**
+ * @brief Formats the measures, e.g. "runs 12, inv 1.2k (0.5%), rem 40,
+ *        max 300, osc 2.1k, dups 0.0%", with the parts joined by sep
+ *
+ * Inversions are also given as a share of the n (n - 1) / 2 of a reversed
+ * sequence.
+ */
+inline std::string format_disorder(const Disorder& d,
+                                   const char* sep = ", ") {
+    double pairs = d.n > 1 ? d.n * (d.n - 1) / 2.0 : 1.0;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "runs %s%sinv %s (%.1f%%)%srem %s%smax %s%s"
+             "osc %s%sdups %.1f%%", format_count((double)d.runs).c_str(), sep,
+             format_count((double)d.inversions).c_str(),
+             100.0 * d.inversions / pairs, sep,
+             format_count((double)d.rem).c_str(), sep,
+             format_count((double)d.max).c_str(), sep,
+             format_count((double)d.osc).c_str(), sep, 100.0 * d.dups);
+    return buf;
+}
+
+
+/***** Verification *****/
+
+/** @brief Scrambles a 64 bit value (the finalizer of splitmix64) */
+inline uint64_t sort_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Hash of the multiset of elements of a sequence
+ *
+ * Sums the scrambled hashes of the elements, so every permutation of a
+ * sequence hashes alike and any other change (an element lost, duplicated,
+ * or altered) almost surely does not. The sum is split over threads, so
+ * checking an output costs a fraction of sorting it.
+ *
+ * @param[in] hash     Hash of one element, as a uint64_t
+ * @param[in] threads  Threads summing the hashes (0 for the cores)
+ */
+template <class T, class H>
+uint64_t multiset_hash(const std::vector<T>& a, H hash,
+                       unsigned threads = 0) {
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned)std::min<size_t>(threads, a.size() / 4096 + 1);
+    std::vector<uint64_t> sums(threads, 0);
+    auto part = [&](unsigned t) {
+        uint64_t s = 0;
+        for (size_t i = t * a.size() / threads;
+             i < (t + 1) * a.size() / threads; i++)
+            s += sort_mix(hash(a[i]));
+        sums[t] = s;
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+        pool.push_back(std::thread(part, t));
+    part(0);
+    for (std::thread& th : pool)
+        th.join();
+    uint64_t s = sort_mix(a.size());
+    for (uint64_t x : sums)
+        s += x;
+    return s;
+}
+
+#endif
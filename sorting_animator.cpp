@@ -6,6 +6,38 @@
  *      - Comparisons between data elements are detected by hacking into the
  *        comparison function supplied during the sort and forcing a draw
  *        after every comparison.
+ *      - Comparisons, element reads, writes, moves, and swaps, and scratch
+ *        allocations are counted per sort in thread-local batches (see
+ *        sorting_stats.h) that are merged once per frame and shown in an
+ *        overlay on each sort's pane. Copies of SortingDatum report
+ *        themselves, so writes made by swaps, std::copy, and scratch buffers
+ *        are all visible and drawn in their own color.
+ *      - Writes are also reported to a per-sort observer that keeps the
+ *        number of inversions up to date (see sorting_analysis.h) and samples
+ *        it over time to plot how fast each sort removes disorder.
+ *      - Scratch buffers registered by the sorts (see SortScratch) are drawn
+ *        as strips under each pane, and their size is plotted over time.
+ *      - Parallel sorts also show how many tasks they forked, their average
+ *        size, and the share of CPU time spent starting threads.
+ *      - Built with sorting_alloc.cpp, the overlay also shows the heap
+ *        allocations of each sort, their bytes, and their peak.
+ *      - With the cache simulation on (C on the configuration screen), the
+ *        accesses of each sort also run through a small simulated cache
+ *        hierarchy (see sorting_cache.h); the overlay shows the misses of
+ *        each level and a strip over the footer shows where in the data the
+ *        first level missed.
+ *      - Every frame is timed by phase (clear, geometry build, draw calls,
+ *        display) along with how long the drawing thread waited for the
+ *        window lock. With the profiler on (F on the configuration screen),
+ *        each pane plots its recent frame times and a histogram of its lock
+ *        waits; both are saved to sort_frames.json. The bars of all panes
+ *        are built into one vertex array and drawn with a single call.
+ *      - Each sort is traced (see SortSpan): its recursive calls, partitions,
+ *        merges, and forks are saved with the other run data as a Chrome
+ *        trace to show on a timeline per thread.
+ *      - Threads of a sort hold worker IDs (see sort_bind); parallel sorts
+ *        color each element by the worker that last wrote it and chart
+ *        when each worker was running or waiting.
  *      - To perform multiple sorts at the same time, threads are used. This
  *        also means that the animation may not be accurate in terms of speed
  *        because the operating system may give some threads priority over
@@ -21,13 +53,16 @@
 
 #include "sorting.h"
 #include "sorting_animator.h"
+#include "sorting_report.h"
 #include <string>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <functional>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <random>
 #include <SFML/Graphics.hpp>
 
 
@@ -64,6 +99,112 @@ void resize(sf::RenderWindow& window, int w, int h) {
     window.setView(sf::View(sf::FloatRect(0.0f, 0.0f, (float)w, (float)h)));
 }
 
+sf::Color worker_color(int w) {
+    if (w < 0)
+        return sf::Color::White;
+    float h = std::fmod(w * 0.618034f, 1.0f) * 6.0f;
+    float x = 1.0f - std::fabs(std::fmod(h, 2.0f) - 1.0f);
+    float rgb[6][3] = {
+        { 1, x, 0 }, { x, 1, 0 }, { 0, 1, x },
+        { 0, x, 1 }, { x, 0, 1 }, { 1, 0, x }
+    };
+    float* c = rgb[(int)h % 6];
+    return sf::Color((sf::Uint8)(55 + 200 * c[0]),
+                     (sf::Uint8)(55 + 200 * c[1]),
+                     (sf::Uint8)(55 + 200 * c[2]));
+}
+
+/***** Sorting Classes *****/
+
+void SortingWatch::attach(const std::vector<SortingDatum>& data) {
+    base = data.data();
+    n    = data.size();
+    std::vector<int> values(n);
+    for (size_t i = 0; i < n; i++)
+        values[i] = data[i].value;
+    disorder.reset(values);
+    progress.clear();
+}
+
+void SortingWatch::sample(const SortStats& stats, bool force) {
+    double time = stats.elapsed();
+    if (!force && !progress.empty() && time - progress.back().time < 1e-3)
+        return;
+    uint64_t waiting = stats.workers_waiting;
+    progress.push_back({
+        time, disorder.inversions(), disorder.runs(), stats.aux_bytes,
+        stats.workers_live & ~waiting, waiting
+    });
+}
+
+void SortingWatch::on_access(SortAccess kind, const void* p) {
+    const SortingDatum* d = (const SortingDatum*)p;
+    if (kind == SortAccess::WRITE && base <= d && d < base + n)
+        disorder.update(d - base, d->value);
+}
+
+void SortingWatch::on_scratch(const void* data, size_t n, size_t size,
+                              bool live) {
+    std::lock_guard<std::mutex> lock(scratch_m);
+    if (live) {
+        scratch.push_back({ (const SortingDatum*)data, n });
+        return;
+    }
+    for (size_t i = 0; i < scratch.size(); i++) {
+        if (scratch[i].data == data) {
+            scratch.erase(scratch.begin() + i);
+            return;
+        }
+    }
+}
+
+FrameTimer::FrameTimer(int sort, double wait) : mark(sort_wall_ns()) {
+    sample.time = 0.0;
+    for (int p = 0; p < FRAME_PHASES; p++)
+        sample.phase[p] = 0.0;
+    sample.wait = wait;
+    sample.sort = sort;
+}
+
+void FrameTimer::lap(FramePhase p) {
+    int64_t now = sort_wall_ns();
+    sample.phase[(int)p] += (now - mark) * 1e-9;
+    mark = now;
+}
+
+void FrameProfile::reset(size_t sorts) {
+    std::lock_guard<std::mutex> lock(m);
+    origin = sort_wall_ns();
+    frames.clear();
+    count = 0;
+    for (int p = 0; p < FRAME_PHASES; p++)
+        total[p] = 0.0;
+    sort_frames.assign(sorts, 0);
+    sort_wait.assign(sorts, 0.0);
+    sort_waits.assign(sorts, std::vector<uint64_t>(FRAME_WAIT_BUCKETS, 0));
+}
+
+void FrameProfile::add(FrameTimer& timer) {
+    FrameSample& f = timer.sample;
+    std::lock_guard<std::mutex> lock(m);
+    f.time = (timer.mark - origin) * 1e-9;
+    if (frames.size() >= FRAME_SAMPLES_MAX)
+        frames.erase(frames.begin(), frames.begin() + FRAME_SAMPLES_MAX / 2);
+    frames.push_back(f);
+    count++;
+    for (int p = 0; p < FRAME_PHASES; p++)
+        total[p] += f.phase[p];
+    if (f.sort < 0 || f.sort >= (int)sort_frames.size())
+        return;
+    int b = 0;
+    for (double us = f.wait * 1e6; us >= 1.0 && b < FRAME_WAIT_BUCKETS - 1;
+         us /= 2.0)
+        b++;
+    sort_frames[f.sort]++;
+    sort_wait[f.sort] += f.wait;
+    sort_waits[f.sort][b]++;
+}
+
 /***** Setup *****/
 
 SortingAnimator::SortingAnimator() {
@@ -77,13 +218,24 @@ SortingAnimator::SortingAnimator() {
     text_size   = 50;
     text_sizef  = 50.0f;
     text_vspace = 25.0f;
+    log_accesses = false;
+    sim_cache    = false;
+    show_profile = false;
+    cache_levels = { { 256, 2, 32 }, { 1024, 4, 32 }, { 4096, 8, 32 } };
+    sort_footer  = 2.0f * text_vspace;
 
     setup_start();
     setup_help_wrapper();
     sort_n = 100;
+    sort_input = InputDist::RANDOM;
+    sort_seed  = std::random_device()();
+    disorder_n = (size_t)-1;
     sort_cmp = [&](SortingDatum& x, SortingDatum& y) {
         x.timer = 5;
         y.timer = 5;
+        sort_note_read(&x);
+        sort_note_read(&y);
+        sort_count_cmp();
         sort_draw_data();
         return x.value <= y.value;
     };
@@ -246,6 +398,10 @@ void SortingAnimator::setup_config() {
 
     config_boxes.push_back(cont_box);
 
+    config_input_text.setFont(text_font);
+    config_input_text.setCharacterSize(text_size * 2 / 5);
+    config_input_text.setFillColor(sf::Color::Red);
+
     float pi = 3.1415f;
     float s  = text_vspace;
     float t  = pi / 6;
@@ -270,6 +426,32 @@ void SortingAnimator::update_n() {
     config_n_string = std::to_string(sort_n);
 }
 
+void SortingAnimator::update_input(int step) {
+    int k = (int)input_dists().size();
+    sort_input = (InputDist)(((int)sort_input + step + k) % k);
+}
+
+void SortingAnimator::update_cost(int64_t& ns, int step) {
+    const std::vector<int64_t> costs = { 0, 100, 1000, 10000, 100000,
+                                         1000000 };
+    size_t i = 0;
+    while (i + 1 < costs.size() && costs[i] < ns)
+        i++;
+    int k = (int)costs.size();
+    ns = costs[((int)i + step + k) % k];
+}
+
+void SortingAnimator::update_disorder() {
+    if (disorder_n == sort_n && disorder_input == sort_input
+        && disorder_seed == sort_seed)
+        return;
+    sort_disorder  = measure_disorder(generate_input(sort_input, sort_n,
+                                                     sort_seed));
+    disorder_n     = sort_n;
+    disorder_input = sort_input;
+    disorder_seed  = sort_seed;
+}
+
 void SortingAnimator::update_help_scroll() {
     if (help_scroll < 0.0f)
         help_scroll = 0;
@@ -368,6 +550,18 @@ void SortingAnimator::handle_key_config(sf::Event event) {
     } else if (event.key.code == sf::Keyboard::H) {
         mode = Mode::HELP;
         return;
+    } else if (event.key.code == sf::Keyboard::D) {
+        update_input(event.key.shift ? -1 : 1);
+    } else if (event.key.code == sf::Keyboard::C) {
+        sim_cache = !sim_cache;
+    } else if (event.key.code == sf::Keyboard::F) {
+        show_profile = !show_profile;
+    } else if (event.key.code == sf::Keyboard::K) {
+        update_cost(sort_costs().cmp_ns, event.key.shift ? -1 : 1);
+    } else if (event.key.code == sf::Keyboard::W) {
+        update_cost(sort_costs().write_ns, event.key.shift ? -1 : 1);
+    } else if (event.key.code == sf::Keyboard::I) {
+        update_cost(sort_costs().indirect_ns, event.key.shift ? -1 : 1);
     } else if (event.key.code == sf::Keyboard::Up) {
         config_field = std::max(0, config_field - 1);
         if (!config_field)
@@ -456,6 +650,12 @@ void SortingAnimator::handle_key_sorted(sf::Event event) {
             sort_data.clear();
             sort_queue.clear();
             sort_threads.clear();
+            sort_stats.clear();
+            sort_perf.clear();
+            sort_watches.clear();
+            sort_logs.clear();
+            sort_caches.clear();
+            sort_traces.clear();
         }
         mode = Mode::CONFIG;
         break;
@@ -465,6 +665,9 @@ void SortingAnimator::handle_key_sorted(sf::Event event) {
                 sort_data[i][j].value = sort_data[sort_queue.size()][j].value;
         }
         mode = Mode::SORTING;
+        break;
+    case (sf::Keyboard::S):
+        sort_save();
     }
 }
 
@@ -491,6 +694,11 @@ void SortingAnimator::handle_mouse_pressed(sf::Event event) {
             update_config_scroll();
             return;
         }
+        sf::FloatRect input_box = config_input_text.getGlobalBounds();
+        if (in_box(input_box, (float)mx, (float)my)) {
+            update_input(1);
+            return;
+        }
         if (in_box(config_boxes[0], (float)mx, (float)my)) {
             config_field = 0;
             config_entry = config_n_string.size();
@@ -581,7 +789,9 @@ void SortingAnimator::draw_start() {
 }
 
 void SortingAnimator::draw_help() {
+    FrameTimer timer(-1, 0.0);
     window.clear(sf::Color::Black);
+    timer.lap(FramePhase::CLEAR);
     for (size_t i = 0; i < help_lines.size(); i++) {
         if (help_scroll < 0.0f)
             window.draw(help_lines[i]);
@@ -611,11 +821,16 @@ void SortingAnimator::draw_help() {
         scroll.setOutlineColor(sf::Color::White);
         window.draw(scroll);
     }
+    timer.lap(FramePhase::DRAW);
     window.display();
+    timer.lap(FramePhase::DISPLAY);
+    frame_profile.add(timer);
 }
 
 void SortingAnimator::draw_config() {
+    FrameTimer timer(-1, 0.0);
     window.clear(sf::Color::Black);
+    timer.lap(FramePhase::CLEAR);
 
     bool has_scroll = config_scroll >= 0.0f;
     if (!has_scroll)
@@ -683,7 +898,28 @@ void SortingAnimator::draw_config() {
         window.draw(scroll);
     }
 
+    sf::FloatRect input_box;
+    const SortCosts& costs = sort_costs();
+    auto cost = [](int64_t ns) {
+        return ns ? format_secs(ns * 1e-9) : std::string("none");
+    };
+    update_disorder();
+    config_input_text.setString(
+        "Input (D): " + input_name(sort_input)
+      + "\nSeed: " + std::to_string(sort_seed)
+      + "\n" + format_disorder(sort_disorder, "\n")
+      + "\nCache (C): " + (sim_cache ? "on" : "off")
+      + "\nProfiler (F): " + (show_profile ? "on" : "off")
+      + "\nCompare cost (K): " + cost(costs.cmp_ns)
+      + "\nWrite cost (W): " + cost(costs.write_ns)
+      + "\nRead cost (I): " + cost(costs.indirect_ns)
+    );
+    input_box = config_input_text.getLocalBounds();
+    config_input_text.setOrigin(get_xright(input_box), input_box.top);
+    config_input_text.setPosition(width - text_sizef, text_sizef);
+
     window.draw(config_n_text);
+    window.draw(config_input_text);
     window.draw(config_sort_title);
     window.draw(config_cont);
     if (!in_btw<int>(1, sort_algos.size(), config_field)
@@ -694,7 +930,10 @@ void SortingAnimator::draw_config() {
 
     if (!has_scroll)
         config_scroll = -1.0f;
+    timer.lap(FramePhase::DRAW);
     window.display();
+    timer.lap(FramePhase::DISPLAY);
+    frame_profile.add(timer);
 }
 
 /***** Visualizing Sorting *****/
@@ -713,16 +952,25 @@ void SortingAnimator::sort_setup() {
         return;
     }
 
+    std::vector<int> input = generate_input(sort_input, sort_n, sort_seed++);
+    sort_input_hash = multiset_hash(input, [](int x) { return (uint64_t)x; });
     sort_data.push_back(std::vector<SortingDatum>());
     for (size_t i = 0; i < sort_n; i++)
-        sort_data[0].push_back(SortingDatum(i + 1));
-    std::random_shuffle(sort_data[0].begin(), sort_data[0].end());
+        sort_data[0].push_back(SortingDatum(input[i]));
     for (size_t j = 1; j < sort_queue.size() + 1; j++) {
         sort_data.push_back(std::vector<SortingDatum>());
         for (size_t i = 0; i < sort_n; i++)
             sort_data[j].push_back(SortingDatum(sort_data[0][i].value));
     }
 
+    sort_stats   = std::vector<SortStats>(sort_queue.size());
+    sort_watches = std::vector<SortingWatch>(sort_queue.size());
+    sort_perf    = std::vector<PerfCounts>(sort_queue.size());
+    sort_ok      = std::vector<signed char>(sort_queue.size(), -1);
+    sort_logs    = std::vector<SortAccessLog>(sort_queue.size());
+    sort_caches  = std::vector<CacheSim>(sort_queue.size());
+    sort_traces  = std::vector<SortTrace>(sort_queue.size());
+
     resize(window, width, sort_queue.size() * height);
     window.clear(sf::Color::Black);
     window.display();
@@ -731,50 +979,537 @@ void SortingAnimator::sort_setup() {
 
 
 void SortingAnimator::sort_launch() {
+    frame_profile.reset(sort_queue.size());
+    for (size_t i = 0; i < sort_queue.size(); i++) {
+        sort_ok[i] = -1;
+        sort_stats[i].reset();
+        sort_stats[i].track(sort_data[i]);
+        sort_watches[i].attach(sort_data[i]);
+        sort_stats[i].watches = { &sort_watches[i] };
+        sort_logs[i].records.clear();
+        sort_traces[i].take();
+        sort_stats[i].trace = &sort_traces[i];
+        if (log_accesses)
+            sort_stats[i].watches.push_back(&sort_logs[i]);
+        if (sim_cache) {
+            sort_caches[i].configure(cache_levels);
+            sort_caches[i].track(sort_data[i].data(), sort_n,
+                                 sizeof(SortingDatum));
+            sort_stats[i].watches.push_back(&sort_caches[i]);
+        }
+        sort_stats[i].start();
+    }
     for (size_t i = 0; i < sort_queue.size(); i++)
         sort_threads[i] = std::thread(
             [&](int i) {
+                PerfCounters counters;
+                sort_bind(&sort_stats[i]);
+                counters.start();
                 sort_algos[sort_queue[i]].sort(sort_data[i], sort_cmp);
+                sort_perf[i] = counters.stop();
+                sort_bind(NULL);
+                sort_stats[i].stop();
             },
             i
         );
     for (size_t i = 0; i < sort_queue.size(); i++)
         sort_threads[i].join();
+    for (size_t i = 0; i < sort_queue.size(); i++)
+        sort_ok[i] = sort_check(sort_data[i]);
     sort_draw_data(true);
     mode = Mode::SORTED;
 }
 
+bool SortingAnimator::sort_check(const std::vector<SortingDatum>& data) {
+    // Reads the values directly, so nothing is counted or drawn
+    for (size_t i = 1; i < data.size(); i++)
+        if (data[i - 1].value > data[i].value)
+            return false;
+    auto value = [](const SortingDatum& d) { return (uint64_t)d.value; };
+    return multiset_hash(data, value) == sort_input_hash;
+}
+
 void SortingAnimator::sort_draw_data(bool end) {
+    sort_flush();
+    int64_t t0 = sort_wall_ns();
     window_m.lock();
+    FrameTimer timer(sort_pane(), (sort_wall_ns() - t0) * 1e-9);
     window.setActive(true);
     window.clear(sf::Color::Black);
-    float dx = (float)width / sort_n;
-    float dy = (float)height / (sort_n + 1);
-    sf::RectangleShape rect;
+    timer.lap(FramePhase::CLEAR);
+
+    float dx  = (float)width / sort_n;
+    float dy  = (height - sort_footer) / (sort_n + 1);
+    float gap = dx > 2.0f ? 1.0f : 0.0f;
+    sf::VertexArray bars(sf::Quads);
+    for (size_t i = 0; i < sort_threads.size(); i++) {
+        bool parallel = sort_stats[i].workers_peak > 1;
+        float bot = (i + 1) * (float)height - sort_footer;
+        for (size_t j = 0; j < sort_n; j++) {
+            SortingDatum& d = sort_data[i][j];
+            sf::Color c;
+            if (end || (!d.timer && !d.written))
+                c = worker_color(parallel ? d.worker : -1);
+            else if (d.timer) {
+                c = sf::Color::Red;
+                d.timer--;
+            } else {
+                c = sf::Color::Cyan;
+                d.written--;
+            }
+            float x0 = j * dx, x1 = x0 + dx - gap, top = bot - d.value * dy;
+            bars.append(sf::Vertex(sf::Vector2f(x0, top), c));
+            bars.append(sf::Vertex(sf::Vector2f(x1, top), c));
+            bars.append(sf::Vertex(sf::Vector2f(x1, bot), c));
+            bars.append(sf::Vertex(sf::Vector2f(x0, bot), c));
+        }
+    }
+    timer.lap(FramePhase::BUILD);
+
+    window.draw(bars);
     sf::Text name;
-    rect.setOutlineThickness(1.0f);
-    rect.setOutlineColor(sf::Color::Black);
     name.setCharacterSize(text_size);
     name.setFont(text_font);
     name.setFillColor(sf::Color::Blue);
     for (size_t i = 0; i < sort_threads.size(); i++) {
-        for (size_t j = 0; j < sort_n; j++) {
-            rect.setSize(sf::Vector2f(dx, sort_data[i][j].value * dy));
-            rect.setOrigin(sf::Vector2f(0, sort_data[i][j].value * dy));
-            rect.setPosition(sf::Vector2f(j * dx, (i + 1) * (float)height));
-            if (end || !sort_data[i][j].timer)
-                rect.setFillColor(sf::Color::White);
-            else {
-                rect.setFillColor(sf::Color::Red);
-                sort_data[i][j].timer--;
-            }
-            window.draw(rect);
-        }
         name.setString(sort_algos[sort_queue[i]].name);
         name.setPosition(0.0f, i * (float)height);
         window.draw(name);
+        sort_watches[i].sample(sort_stats[i], end);
+        sort_draw_scratch(i);
+        sort_draw_progress(i);
+        sort_draw_hud(i);
+        if (show_profile)
+            sort_draw_profile(i);
     }
+    timer.lap(FramePhase::DRAW);
     window.display();
+    timer.lap(FramePhase::DISPLAY);
     window.setActive(false);
+    frame_profile.add(timer);
     window_m.unlock();
+}
+
+int SortingAnimator::sort_pane() {
+    SortStats* stats = sort_bound();
+    if (!stats || sort_stats.empty())
+        return -1;
+    ptrdiff_t i = stats - sort_stats.data();
+    return 0 <= i && i < (ptrdiff_t)sort_stats.size() ? (int)i : -1;
+}
+
+void SortingAnimator::sort_draw_hud(size_t i) {
+    const SortStats& s = sort_stats[i];
+    std::string str = "cmp     " + format_count(s.comparisons)
+                    + "\nreads   " + format_count(s.reads)
+                    + "\nwrites  " + format_count(s.writes)
+                    + "\nmoves   " + format_count(s.moves)
+                    + "\nswaps   " + format_count(s.swaps)
+                    + "\nthreads " + std::to_string(s.workers_peak)
+                    + "\naux     " + format_bytes(s.aux_bytes)
+                    + " (peak " + format_bytes(s.aux_peak) + ", "
+                    + std::to_string(s.allocs) + " allocs)"
+                    + "\ncpu     " + format_secs(s.cpu_ns * 1e-9)
+                    + "\nwall    " + format_secs(s.elapsed())
+                    + "\nrate    " + format_count(s.throughput()) + " ops/s";
+    SortTasks tasks = s.fork_tasks();
+    if (tasks.tasks) {
+        char buf[96];
+        snprintf(buf, sizeof(buf), "\ntasks   %s (avg %.1f), spawn %.0f%% cpu",
+                 format_count(tasks.tasks).c_str(), tasks.avg_size(),
+                 tasks.cpu_ns ? 100.0 * tasks.spawn_ns / tasks.cpu_ns : 0.0);
+        str += buf;
+    }
+    if (sort_heap_hooked())
+        str += "\nheap    " + format_heap(s.heap());
+    SortChoice choice = sort_stats[i].chosen();
+    if (choice.engine)
+        str += "\nchose   " + format_choice(choice);
+    if (sort_ok[i] >= 0)
+        str += std::string("\ncheck   ")
+             + (sort_ok[i] ? "sorted" : "NOT SORTED (or elements lost)");
+    if (sim_cache)
+        str += "\n" + format_cache(sort_caches[i], "\n");
+    if (s.stop_ns)
+        str += "\n" + format_perf(sort_perf[i], "\n");
+
+    sf::Text hud;
+    hud.setString(str);
+    hud.setFont(text_font);
+    hud.setCharacterSize(text_size * 2 / 5);
+    hud.setFillColor(sf::Color::White);
+    sf::FloatRect hud_box = hud.getLocalBounds();
+    hud.setOrigin(get_xright(hud_box), hud_box.top);
+    hud.setPosition(width - text_vspace, i * (float)height + text_vspace);
+
+    sf::RectangleShape back;
+    hud_box = hud.getGlobalBounds();
+    back.setSize(sf::Vector2f(hud_box.width + text_vspace,
+                              hud_box.height + text_vspace));
+    back.setPosition(hud_box.left - 0.5f * text_vspace,
+                     hud_box.top - 0.5f * text_vspace);
+    back.setFillColor(sf::Color(0, 0, 0, 160));
+    window.draw(back);
+    window.draw(hud);
+}
+
+void SortingAnimator::sort_draw_progress(size_t i) {
+    SortingWatch& w = sort_watches[i];
+    if (w.progress.empty())
+        return;
+    sf::FloatRect box(text_vspace, i * (float)height + 2.0f * text_sizef,
+                      5.0f * text_sizef, 1.5f * text_sizef);
+
+    const SortingSample& last = w.progress.back();
+    double tmax = std::max(last.time, 1e-9);
+    double imax = std::max<uint64_t>(w.disorder.max_inversions(), 1);
+    double amax = std::max<int64_t>(sort_stats[i].aux_peak, 1);
+    std::vector<sf::Vector2f> inv, aux;
+    for (const SortingSample& s : w.progress) {
+        float x = (float)(s.time / tmax);
+        inv.push_back(sf::Vector2f(x, (float)(s.inversions / imax)));
+        aux.push_back(sf::Vector2f(x, (float)(s.aux_bytes / amax)));
+    }
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "inv %.1f%%  runs %zu",
+             100.0 * last.inversions / imax, last.runs);
+    sort_draw_plot(box, inv, sf::Color::Green, buf);
+    box.top += box.height + text_sizef;
+    sort_draw_plot(box, aux, sf::Color::Yellow,
+                   "aux " + format_bytes(last.aux_bytes)
+                 + "  peak " + format_bytes(sort_stats[i].aux_peak));
+    if (sort_stats[i].workers_peak > 1) {
+        box.top += box.height + text_sizef;
+        sort_draw_workers(i, box);
+    }
+}
+
+void SortingAnimator::sort_draw_workers(size_t i, sf::FloatRect box) {
+    const SortStats& stats = sort_stats[i];
+    const std::vector<SortingSample>& p = sort_watches[i].progress;
+    int rows = std::min<int>(stats.workers_peak, SORT_MAX_WORKERS);
+
+    sf::RectangleShape back;
+    back.setSize(sf::Vector2f(box.width, box.height));
+    back.setPosition(box.left, box.top);
+    back.setFillColor(sf::Color(0, 0, 0, 160));
+    back.setOutlineThickness(1.0f);
+    back.setOutlineColor(sf::Color(128, 128, 128));
+    window.draw(back);
+
+    double tmax  = std::max(p.back().time, 1e-9);
+    float  row_h = box.height / rows;
+    sf::VertexArray cells(sf::Quads);
+    for (size_t j = 0; j + 1 < p.size(); j++) {
+        float x0 = box.left + box.width * (float)(p[j].time / tmax);
+        float x1 = box.left + box.width * (float)(p[j + 1].time / tmax);
+        for (int w = 0; w < rows; w++) {
+            sf::Color c;
+            if (p[j].workers_busy >> w & 1)
+                c = worker_color(w);
+            else if (p[j].workers_waiting >> w & 1)
+                c = sf::Color(80, 80, 80);
+            else
+                continue;
+            float y0 = box.top + w * row_h, y1 = y0 + row_h;
+            cells.append(sf::Vertex(sf::Vector2f(x0, y0), c));
+            cells.append(sf::Vertex(sf::Vector2f(x1, y0), c));
+            cells.append(sf::Vertex(sf::Vector2f(x1, y1), c));
+            cells.append(sf::Vertex(sf::Vector2f(x0, y1), c));
+        }
+    }
+    window.draw(cells);
+
+    double busy = 0.0;
+    for (int w = 0; w < rows; w++)
+        busy += stats.worker_busy_ns[w] * 1e-9;
+    char buf[64];
+    snprintf(buf, sizeof(buf), "workers %d  busy %.0f%%", rows,
+             100.0 * busy / (rows * std::max(stats.elapsed(), 1e-9)));
+    sf::Text text;
+    text.setString(buf);
+    text.setFont(text_font);
+    text.setCharacterSize(text_size * 2 / 5);
+    text.setFillColor(sf::Color::White);
+    text.setPosition(box.left, get_ybot(box));
+    window.draw(text);
+}
+
+void SortingAnimator::sort_draw_plot(sf::FloatRect box,
+                                     const std::vector<sf::Vector2f>& points,
+                                     sf::Color color,
+                                     const std::string& label) {
+    sf::RectangleShape back;
+    back.setSize(sf::Vector2f(box.width, box.height));
+    back.setPosition(box.left, box.top);
+    back.setFillColor(sf::Color(0, 0, 0, 160));
+    back.setOutlineThickness(1.0f);
+    back.setOutlineColor(sf::Color(128, 128, 128));
+    window.draw(back);
+
+    sf::VertexArray line(sf::LineStrip, points.size());
+    for (size_t j = 0; j < points.size(); j++) {
+        float x = box.left + box.width * points[j].x;
+        float y = get_ybot(box) - box.height * points[j].y;
+        line[j] = sf::Vertex(sf::Vector2f(x, y), color);
+    }
+    window.draw(line);
+
+    sf::Text text;
+    text.setString(label);
+    text.setFont(text_font);
+    text.setCharacterSize(text_size * 2 / 5);
+    text.setFillColor(sf::Color::White);
+    text.setPosition(box.left, get_ybot(box));
+    window.draw(text);
+}
+
+void SortingAnimator::sort_draw_scratch(size_t i) {
+    float top = (i + 1) * (float)height - sort_footer;
+    sf::RectangleShape back;
+    back.setSize(sf::Vector2f((float)width, sort_footer));
+    back.setPosition(0.0f, top);
+    back.setFillColor(sf::Color(32, 32, 32));
+    window.draw(back);
+
+    float footer = sort_footer;
+    if (sim_cache) {
+        float heat_h = 0.25f * sort_footer;
+        sort_draw_heat(i, sf::FloatRect(0.0f, top, (float)width, heat_h));
+        top    += heat_h;
+        footer -= heat_h;
+    }
+
+    SortingWatch& w = sort_watches[i];
+    std::lock_guard<std::mutex> lock(w.scratch_m);
+    if (w.scratch.empty())
+        return;
+    float dx    = (float)width / sort_n;
+    float row_h = footer / w.scratch.size();
+    float dy    = row_h / (sort_n + 1);
+    sf::VertexArray bars(sf::Quads);
+    for (size_t r = 0; r < w.scratch.size(); r++) {
+        float bot = top + (r + 1) * row_h;
+        for (size_t k = 0; k < w.scratch[r].n; k++) {
+            float h = w.scratch[r].data[k].value * dy;
+            float x = k * dx;
+            sf::Color c = sf::Color::Yellow;
+            bars.append(sf::Vertex(sf::Vector2f(x, bot - h), c));
+            bars.append(sf::Vertex(sf::Vector2f(x + dx, bot - h), c));
+            bars.append(sf::Vertex(sf::Vector2f(x + dx, bot), c));
+            bars.append(sf::Vertex(sf::Vector2f(x, bot), c));
+        }
+    }
+    window.draw(bars);
+}
+
+void SortingAnimator::sort_draw_heat(size_t i, sf::FloatRect box) {
+    std::vector<uint64_t> heat = sort_caches[i].heatmap();
+    uint64_t most = 1;
+    for (uint64_t h : heat)
+        most = std::max(most, h);
+    float dx = box.width / std::max<size_t>(heat.size(), 1);
+    sf::VertexArray cells(sf::Quads);
+    for (size_t k = 0; k < heat.size(); k++) {
+        float t = (float)heat[k] / most;
+        sf::Color c((sf::Uint8)(255 * std::min(1.0f, 2.0f * t)),
+                    (sf::Uint8)(255 * std::max(0.0f, 2.0f * t - 1.0f)), 0);
+        float x = box.left + k * dx;
+        cells.append(sf::Vertex(sf::Vector2f(x, box.top), c));
+        cells.append(sf::Vertex(sf::Vector2f(x + dx, box.top), c));
+        cells.append(sf::Vertex(sf::Vector2f(x + dx, get_ybot(box)), c));
+        cells.append(sf::Vertex(sf::Vector2f(x, get_ybot(box)), c));
+    }
+    window.draw(cells);
+}
+
+void SortingAnimator::sort_draw_profile(size_t i) {
+    const size_t shown = 120;
+    std::vector<FrameSample> frames;
+    std::vector<uint64_t> waits;
+    uint64_t count;
+    double wait;
+    {
+        std::lock_guard<std::mutex> lock(frame_profile.m);
+        const std::vector<FrameSample>& all = frame_profile.frames;
+        for (size_t k = all.size(); k-- > 0 && frames.size() < shown;)
+            if (all[k].sort == (int)i)
+                frames.push_back(all[k]);
+        waits = frame_profile.sort_waits[i];
+        count = frame_profile.sort_frames[i];
+        wait  = frame_profile.sort_wait[i];
+    }
+    std::reverse(frames.begin(), frames.end());
+
+    sf::FloatRect box(2.0f * text_vspace + 5.0f * text_sizef,
+                      i * (float)height + 2.0f * text_sizef,
+                      5.0f * text_sizef, 1.5f * text_sizef);
+    sf::RectangleShape back;
+    back.setSize(sf::Vector2f(box.width, box.height));
+    back.setFillColor(sf::Color(0, 0, 0, 160));
+    back.setOutlineThickness(1.0f);
+    back.setOutlineColor(sf::Color(128, 128, 128));
+
+    // Frame times, each stacked as wait, clear, build, draw, and display
+    const sf::Color colors[FRAME_PHASES + 1] = {
+        sf::Color(80, 80, 80), sf::Color::Blue, sf::Color::Green,
+        sf::Color::Yellow, sf::Color::Red
+    };
+    double most = 1e-9, spent = 0.0, waited = 0.0;
+    for (const FrameSample& f : frames) {
+        double t = f.wait;
+        for (int p = 0; p < FRAME_PHASES; p++)
+            t += f.phase[p];
+        most = std::max(most, t);
+        spent  += t;
+        waited += f.wait;
+    }
+    back.setPosition(box.left, box.top);
+    window.draw(back);
+    float dx = box.width / shown;
+    sf::VertexArray cells(sf::Quads);
+    for (size_t k = 0; k < frames.size(); k++) {
+        float x0 = box.left + k * dx, x1 = x0 + dx;
+        float y  = get_ybot(box);
+        for (int p = 0; p <= FRAME_PHASES; p++) {
+            double t = p ? frames[k].phase[p - 1] : frames[k].wait;
+            float  h = (float)(t / most) * box.height;
+            cells.append(sf::Vertex(sf::Vector2f(x0, y - h), colors[p]));
+            cells.append(sf::Vertex(sf::Vector2f(x1, y - h), colors[p]));
+            cells.append(sf::Vertex(sf::Vector2f(x1, y), colors[p]));
+            cells.append(sf::Vertex(sf::Vector2f(x0, y), colors[p]));
+            y -= h;
+        }
+    }
+    window.draw(cells);
+
+    sf::Text text;
+    text.setFont(text_font);
+    text.setCharacterSize(text_size * 2 / 5);
+    text.setFillColor(sf::Color::White);
+    char buf[96];
+    snprintf(buf, sizeof(buf), "frame %s  wait %.0f%%",
+             format_secs(frames.empty() ? 0.0 : spent / frames.size()).c_str(),
+             spent > 0.0 ? 100.0 * waited / spent : 0.0);
+    text.setString(buf);
+    text.setPosition(box.left, get_ybot(box));
+    window.draw(text);
+
+    // Histogram of the waits for the window, on log2 buckets of us
+    box.top += box.height + text_sizef;
+    back.setPosition(box.left, box.top);
+    window.draw(back);
+    uint64_t tallest = 1;
+    for (uint64_t w : waits)
+        tallest = std::max(tallest, w);
+    float bw = box.width / FRAME_WAIT_BUCKETS;
+    sf::VertexArray hist(sf::Quads);
+    for (int b = 0; b < FRAME_WAIT_BUCKETS; b++) {
+        float h  = (float)waits[b] / tallest * box.height;
+        float x0 = box.left + b * bw, x1 = x0 + bw - 1.0f;
+        sf::Color c = sf::Color(255, 128, 0);
+        hist.append(sf::Vertex(sf::Vector2f(x0, get_ybot(box) - h), c));
+        hist.append(sf::Vertex(sf::Vector2f(x1, get_ybot(box) - h), c));
+        hist.append(sf::Vertex(sf::Vector2f(x1, get_ybot(box)), c));
+        hist.append(sf::Vertex(sf::Vector2f(x0, get_ybot(box)), c));
+    }
+    window.draw(hist);
+    text.setString("waits " + format_count((double)count) + ", "
+                 + format_secs(wait) + " (1 us to "
+                 + format_secs(std::ldexp(1e-6, FRAME_WAIT_BUCKETS - 1))
+                 + ")");
+    text.setPosition(box.left, get_ybot(box));
+    window.draw(text);
+}
+
+void SortingAnimator::sort_save() {
+    std::ofstream out("sort_progress.csv");
+    if (!out.is_open()) {
+        std::cout << "Error opening sort_progress.csv" << std::endl;
+        return;
+    }
+    out << "sort,time_s,inversions,runs,aux_bytes\n";
+    for (size_t i = 0; i < sort_watches.size(); i++) {
+        const std::string& name = sort_algos[sort_queue[i]].name;
+        for (const SortingSample& s : sort_watches[i].progress)
+            out << '"' << name << "\"," << s.time << ','
+                << s.inversions << ',' << s.runs << ','
+                << s.aux_bytes << '\n';
+    }
+    out.close();
+
+    std::vector<TraceRun> runs;
+    for (size_t i = 0; i < sort_traces.size(); i++) {
+        std::lock_guard<std::mutex> lock(sort_traces[i].m);
+        runs.push_back({ sort_algos[sort_queue[i]].name,
+                         sort_traces[i].events });
+    }
+    if (!write_trace("sort_trace.json", runs))
+        std::cout << "Error opening sort_trace.json" << std::endl;
+
+    // Frame profile, with the host as in the benchmark's reports
+    FILE* f = fopen("sort_frames.json", "w");
+    if (!f) {
+        std::cout << "Error opening sort_frames.json" << std::endl;
+    } else {
+        const char* phases[FRAME_PHASES] = {
+            "clear", "build", "draw", "display"
+        };
+        std::lock_guard<std::mutex> lock(frame_profile.m);
+        fprintf(f, "{\n  \"host\": %s,\n  \"frames\": %llu,\n  \"phases\": {",
+                json_host(report_host()).c_str(),
+                (unsigned long long)frame_profile.count);
+        for (int p = 0; p < FRAME_PHASES; p++)
+            fprintf(f, "%s\"%s\": %s", p ? ", " : "", phases[p],
+                    json_number(frame_profile.total[p]).c_str());
+        fprintf(f, "},\n  \"sorts\": [");
+        for (size_t i = 0; i < frame_profile.sort_frames.size(); i++) {
+            fprintf(f, "%s\n    {\"sort\": %s, \"frames\": %llu, "
+                       "\"wait\": %s, \"waits_log2_us\": [",
+                    i ? "," : "",
+                    json_quote(sort_algos[sort_queue[i]].name).c_str(),
+                    (unsigned long long)frame_profile.sort_frames[i],
+                    json_number(frame_profile.sort_wait[i]).c_str());
+            for (int b = 0; b < FRAME_WAIT_BUCKETS; b++)
+                fprintf(f, "%s%llu", b ? ", " : "",
+                        (unsigned long long)frame_profile.sort_waits[i][b]);
+            fprintf(f, "]}");
+        }
+        fprintf(f, "\n  ],\n  \"columns\": [\"sort\", \"time\", \"clear\", "
+                   "\"build\", \"draw\", \"display\", \"wait\"],\n"
+                   "  \"samples\": [");
+        const std::vector<FrameSample>& frames = frame_profile.frames;
+        for (size_t k = 0; k < frames.size(); k++) {
+            const FrameSample& s = frames[k];
+            fprintf(f, "%s\n    [%d, %s", k ? "," : "", s.sort,
+                    json_number(s.time).c_str());
+            for (int p = 0; p < FRAME_PHASES; p++)
+                fprintf(f, ", %s", json_number(s.phase[p]).c_str());
+            fprintf(f, ", %s]", json_number(s.wait).c_str());
+        }
+        fprintf(f, "\n  ]\n}\n");
+        fclose(f);
+    }
+    if (!log_accesses)
+        return;
+
+    out.open("sort_accesses.csv");
+    if (!out.is_open()) {
+        std::cout << "Error opening sort_accesses.csv" << std::endl;
+        return;
+    }
+    const char* kinds[] = { "read", "write", "move" };
+    out << "sort,time_s,kind,index\n";
+    for (size_t i = 0; i < sort_logs.size(); i++) {
+        const std::string& name = sort_algos[sort_queue[i]].name;
+        const SortingDatum* base = sort_data[i].data();
+        int64_t t0 = sort_stats[i].start_ns;
+        for (const SortAccessRecord& r : sort_logs[i].records) {
+            const SortingDatum* d = (const SortingDatum*)r.p;
+            long index = (base <= d && d < base + sort_n) ? d - base : -1;
+            out << '"' << name << "\"," << (r.time - t0) * 1e-9 << ','
+                << kinds[(int)r.kind] << ',' << index << '\n';
+        }
+    }
 }
\ No newline at end of file
@@ -12,6 +12,10 @@
 #define __SORTING_ANIMATOR_H__
 
 #include "sorting.h"
+#include "sorting_analysis.h"
+#include "sorting_inputs.h"
+#include "sorting_perf.h"
+#include "sorting_cache.h"
 #include <string>
 #include <vector>
 #include <thread>
@@ -57,6 +61,11 @@ bool in_box(sf::FloatRect r, float x, float y);
  */
 void resize(sf::RenderWindow& window, int w, int h);
 
+/**
+ * @brief Returns a distinct color for a worker ID (white if negative)
+ */
+sf::Color worker_color(int w);
+
 
 /***** Sorting Classes *****/
 
@@ -72,7 +81,13 @@ void resize(sf::RenderWindow& window, int w, int h);
  */
 enum class Mode { START, HELP, CONFIG, SORTING, SORTED };
 
-/** @brief Data to be sorted */
+/**
+ * @brief Data to be sorted
+ *
+ * Copies are instrumented: copying an element counts as a read of the
+ * source and a move (construction) or write (assignment) of the
+ * destination, and is reported to the observers of the current run.
+ */
 struct SortingDatum {
     /** @brief Value to be considered whilst sorting */
     int value;
@@ -85,8 +100,193 @@ struct SortingDatum {
      */
     int timer;
 
-    SortingDatum() : value(0), timer(0) {}
-    SortingDatum(int v) : value(v), timer(0) {}
+    /**
+     * @brief Timer for the color of a recently written element
+     *
+     * If written > 0 (and timer == 0) then the datum is drawn in cyan
+     */
+    int written;
+
+    /**
+     * @brief Worker ID of the thread that last wrote the element
+     *
+     * Used to color the data of sorts that run on several threads
+     */
+    int worker;
+
+    SortingDatum() : value(0), timer(0), written(0), worker(-1) {}
+    SortingDatum(int v) : value(v), timer(0), written(0), worker(-1) {}
+
+    /** @brief Copy construction, counted as a read and a move */
+    SortingDatum(const SortingDatum& d)
+      : value(d.value), timer(d.timer), written(0), worker(sort_worker()) {
+        sort_note_read(&d);
+        sort_note_move(this);
+    }
+
+    /** @brief Assignment, counted as a read and a write */
+    SortingDatum& operator=(const SortingDatum& d) {
+        sort_note_read(&d);
+        value   = d.value;
+        timer   = d.timer;
+        written = 5;
+        worker  = sort_worker();
+        sort_note_write(this);
+        return *this;
+    }
+};
+
+/** @brief Sorts that distribute by key (see sorting.h) use the value */
+template <>
+struct SortKey<SortingDatum> {
+    static const bool keyed = true;
+    static int64_t key(const SortingDatum& d) {
+        sort_note_read(&d);
+        return d.value;
+    }
+};
+
+/** @brief Progress of a sort at some point in time */
+struct SortingSample {
+    /** @brief Seconds since the sort started */
+    double time;
+
+    /** @brief Inversions left in the data */
+    uint64_t inversions;
+
+    /** @brief Ascending runs in the data */
+    size_t runs;
+
+    /** @brief Bytes of auxiliary memory in use */
+    int64_t aux_bytes;
+
+    /** @brief Bit i is set if worker i was running */
+    uint64_t workers_busy;
+
+    /** @brief Bit i is set if worker i was waiting for other threads */
+    uint64_t workers_waiting;
+};
+
+/** @brief Scratch buffer registered by a sort */
+struct SortingScratch {
+    /** @brief First element of the buffer */
+    const SortingDatum* data;
+
+    /** @brief Number of elements in the buffer */
+    size_t n;
+};
+
+/** @brief Observer following the writes made to the data of one sort */
+struct SortingWatch : SortWatch {
+    /** @brief Data of the sort */
+    const SortingDatum* base;
+
+    /** @brief Number of elements at base */
+    size_t n;
+
+    /** @brief Disorder of the data, updated on every write */
+    InversionTracker disorder;
+
+    /** @brief Disorder sampled over time (at most one sample per ms) */
+    std::vector<SortingSample> progress;
+
+    /** @brief Mutex keeping scratch buffers alive while they are drawn */
+    std::mutex scratch_m;
+
+    /** @brief Scratch buffers currently registered by the sort */
+    std::vector<SortingScratch> scratch;
+
+    SortingWatch() : base(NULL), n(0) {}
+
+    /** @brief Starts following a sort's data */
+    void attach(const std::vector<SortingDatum>& data);
+
+    /** @brief Records the current progress if enough time has passed */
+    void sample(const SortStats& stats, bool force = false);
+
+    void on_access(SortAccess kind, const void* p) override;
+
+    void on_scratch(const void* data, size_t n, size_t size,
+                    bool live) override;
+};
+
+/** @brief Enum class for the phases of drawing a frame */
+enum class FramePhase { CLEAR, BUILD, DRAW, DISPLAY };
+
+/** @brief Number of phases in FramePhase */
+const int FRAME_PHASES = 4;
+
+/**
+ * @brief Number of buckets of the lock wait histogram
+ *
+ * Bucket 0 holds waits under 1 us and bucket b > 0 those of 2^(b-1) to 2^b
+ * us; the last bucket also holds anything longer.
+ */
+const int FRAME_WAIT_BUCKETS = 24;
+
+/** @brief Most frames a FrameProfile keeps (older ones are summed only) */
+const size_t FRAME_SAMPLES_MAX = 1 << 18;
+
+/** @brief Timings of one drawn frame */
+struct FrameSample {
+    /** @brief Seconds since the profile was reset, at the end of the frame */
+    double time;
+
+    /** @brief Seconds spent in each phase (see FramePhase) */
+    double phase[FRAME_PHASES];
+
+    /** @brief Seconds the drawing thread waited for the window */
+    double wait;
+
+    /** @brief Index of the sort whose thread drew it (-1 for menus) */
+    int sort;
+};
+
+/** @brief Times the phases of one frame, as it is being drawn */
+struct FrameTimer {
+    FrameSample sample;
+
+    /** @brief Wall time at which the current phase started */
+    int64_t mark;
+
+    /**
+     * @param[in] sort  Index of the sort drawing the frame (-1 for menus)
+     * @param[in] wait  Seconds spent waiting for the window
+     */
+    FrameTimer(int sort, double wait);
+
+    /** @brief Ends the current phase, which is counted as p */
+    void lap(FramePhase p);
+};
+
+/** @brief Frame timings and window lock contention of the animator */
+struct FrameProfile {
+    std::mutex m;
+
+    /** @brief Wall time of the last reset */
+    int64_t origin;
+
+    /** @brief Most recent frames, at most FRAME_SAMPLES_MAX */
+    std::vector<FrameSample> frames;
+
+    /** @brief Frames drawn since the last reset, kept or not */
+    uint64_t count;
+
+    /** @brief Seconds spent in each phase over every frame */
+    double total[FRAME_PHASES];
+
+    /** @brief Frames drawn, seconds waited, and wait histogram per sort */
+    std::vector<uint64_t> sort_frames;
+    std::vector<double> sort_wait;
+    std::vector<std::vector<uint64_t>> sort_waits;
+
+    FrameProfile() { reset(0); }
+
+    /** @brief Forgets every frame and makes room for sorts sorts */
+    void reset(size_t sorts);
+
+    /** @brief Adds a drawn frame */
+    void add(FrameTimer& timer);
 };
 
 /** @brief Struct organizing relevant sort algorithm details */
@@ -121,6 +321,35 @@ public:
     /** @brief Font of every text */
     sf::Font text_font;
 
+    /**
+     * @brief Records every element access of each sort when true
+     *
+     * The log is saved along with the other run data. It grows with every
+     * comparison and copy, so it is off by default.
+     */
+    bool log_accesses;
+
+    /**
+     * @brief Runs the accesses of each sort through a simulated cache when
+     *        true (toggled with C on the configuration screen)
+     */
+    bool sim_cache;
+
+    /**
+     * @brief Cache hierarchy simulated when sim_cache is set
+     *
+     * The animated inputs are small, so the default levels are scaled down
+     * to a few hundred bytes for the misses to show how each sort moves
+     * through the data.
+     */
+    std::vector<CacheConfig> cache_levels;
+
+    /**
+     * @brief Shows the frame times and window lock waits of each sort when
+     *        true (toggled with F on the configuration screen)
+     */
+    bool show_profile;
+
     /** @brief Regular size of (most) text */
     int text_size;
 
@@ -241,6 +470,9 @@ private:
     /** @brief Text for the Continue option */
     sf::Text config_cont;
 
+    /** @brief Text for the input distribution (cycled with D or a click) */
+    sf::Text config_input_text;
+
     /** @brief Vector of bounding boxes of all fields in config mode */
     std::vector<sf::FloatRect> config_boxes;
 
@@ -266,15 +498,66 @@ private:
     /** @brief Quantity of elements to be sorted */
     size_t sort_n;
 
+    /** @brief Distribution of the data to be sorted */
+    InputDist sort_input;
+
+    /** @brief Seed of the data to be sorted (incremented after every use) */
+    uint64_t sort_seed;
+
+    /** @brief Measures of disorder of the next data to be sorted */
+    Disorder sort_disorder;
+
+    /** @brief Size, distribution, and seed sort_disorder was measured for */
+    size_t    disorder_n;
+    InputDist disorder_input;
+    uint64_t  disorder_seed;
+
     /** @brief Vector of data to be sorted (possibly by more than one sort) */
     std::vector<std::vector<SortingDatum>> sort_data;
 
     /** @brief Queue for sorts to be visualized (recorded by index) */
     std::vector<size_t> sort_queue;
 
+    /** @brief Height at the bottom of each pane for scratch buffers */
+    float sort_footer;
+
     /** @brief Threads for each sort selected for visualization */
     std::vector<std::thread> sort_threads;
 
+    /** @brief Statistics for each sort selected for visualization */
+    std::vector<SortStats> sort_stats;
+
+    /**
+     * @brief Hardware counters for each sort, read when the sort finishes
+     *
+     * They count everything the sort's threads do, drawing included.
+     */
+    std::vector<PerfCounts> sort_perf;
+
+    /**
+     * @brief Whether each sort left its data sorted and a permutation of
+     *        the input: -1 until every sort has finished, then 1 or 0
+     */
+    std::vector<signed char> sort_ok;
+
+    /** @brief multiset_hash() of the input of the current sorts */
+    uint64_t sort_input_hash;
+
+    /** @brief Observers for each sort selected for visualization */
+    std::vector<SortingWatch> sort_watches;
+
+    /** @brief Access logs for each sort (empty unless log_accesses) */
+    std::vector<SortAccessLog> sort_logs;
+
+    /** @brief Frame timings of every screen (see sort_draw_profile) */
+    FrameProfile frame_profile;
+
+    /** @brief Simulated caches for each sort (unused unless sim_cache) */
+    std::vector<CacheSim> sort_caches;
+
+    /** @brief Sections traced during each sort (see SortSpan) */
+    std::vector<SortTrace> sort_traces;
+
 
     /** @brief Sets up texts for start screen */
     void setup_start();
@@ -292,6 +575,25 @@ private:
     /** @brief Update sort_n according to config_n_string */
     void update_n();
 
+    /**
+     * @brief Switches to the next (or previous) input distribution
+     *
+     * @param[in] step  1 for the next distribution, -1 for the previous one
+     */
+    void update_input(int step);
+
+    /**
+     * @brief Switches a cost of sort_costs() to the next (or previous) of
+     *        0, 100 ns, 1 us, ..., 1 ms
+     *
+     * @param[in] ns    Cost to change
+     * @param[in] step  1 for the next cost, -1 for the previous one
+     */
+    void update_cost(int64_t& ns, int step);
+
+    /** @brief Measures sort_disorder again if the next data changed */
+    void update_disorder();
+
     /** @brief Updates scroll to prevent scrolling pass the screen */
     void update_help_scroll();
 
@@ -351,6 +653,12 @@ private:
     /** @brief Begin sorting */
     void sort_launch();
 
+    /**
+     * @brief Tells whether data holds the values of the input in order,
+     *        without counting or drawing anything
+     */
+    bool sort_check(const std::vector<SortingDatum>& data);
+
     /**
      * @brief Draws the data being sorted
      *
@@ -362,6 +670,98 @@ private:
      * param[in] end  Indicator for end of sort
      */
     void sort_draw_data(bool end = false);
+
+    /**
+     * @brief Draws the metrics overlay of one sort
+     *
+     * Shows comparisons, reads, writes, moves, auxiliary memory, peak thread
+     * count, CPU and wall time, throughput, forked tasks, heap allocations
+     * (if sorting_alloc.cpp is linked), simulated cache misses (if
+     * sim_cache is set), and (once the sort is done) hardware counters in
+     * the top right corner of the sort's pane.
+     *
+     * @param[in] i  Index of the sort in sort_queue
+     */
+    void sort_draw_hud(size_t i);
+
+    /**
+     * @brief Draws the progress of one sort over time
+     *
+     * Plots the fraction of inversions left and the auxiliary memory in use
+     * (relative to its peak) against time in the top left corner of the
+     * sort's pane, followed by the workers' activity if the sort ran on
+     * more than one thread.
+     *
+     * @param[in] i  Index of the sort in sort_queue
+     */
+    void sort_draw_progress(size_t i);
+
+    /**
+     * @brief Draws a small line plot with a label underneath
+     *
+     * @param[in] box     Area of the plot
+     * @param[in] points  Points of the line, with coordinates in [0, 1]
+     * @param[in] color   Color of the line
+     * @param[in] label   Text under the plot
+     */
+    void sort_draw_plot(sf::FloatRect box,
+                        const std::vector<sf::Vector2f>& points,
+                        sf::Color color, const std::string& label);
+
+    /**
+     * @brief Draws the scratch buffers of one sort under its pane
+     *
+     * Each registered buffer gets a strip of bars in the pane's footer.
+     *
+     * @param[in] i  Index of the sort in sort_queue
+     */
+    void sort_draw_scratch(size_t i);
+
+    /**
+     * @brief Draws the simulated first level cache misses of one sort
+     *
+     * Colors a strip at the top of the pane's footer by the misses on each
+     * element so far, from black (none) through red to yellow (most).
+     *
+     * @param[in] i    Index of the sort in sort_queue
+     * @param[in] box  Area of the strip
+     */
+    void sort_draw_heat(size_t i, sf::FloatRect box);
+
+    /**
+     * @brief Draws the frame profile of one sort
+     *
+     * Plots the time of the last frames the sort's thread drew, stacked by
+     * phase (clear, geometry build, draw calls, display) on top of the time
+     * it waited for the window, followed by a histogram of those waits.
+     *
+     * @param[in] i  Index of the sort in sort_queue
+     */
+    void sort_draw_profile(size_t i);
+
+    /** @brief Index of the sort the calling thread works on (-1 if none) */
+    int sort_pane();
+
+    /**
+     * @brief Draws which workers of one sort were busy or idle over time
+     *
+     * One row per worker ID: colored while running, gray while waiting for
+     * other threads, and empty while no thread holds the ID.
+     *
+     * @param[in] i    Index of the sort in sort_queue
+     * @param[in] box  Area of the chart
+     */
+    void sort_draw_workers(size_t i, sf::FloatRect box);
+
+    /**
+     * @brief Saves the data recorded during the last sort
+     *
+     * Writes the progress samples of every sort to sort_progress.csv, the
+     * traced sections to sort_trace.json (see write_trace()), the frame
+     * profile to sort_frames.json, and, if
+     * log_accesses is set, every access to sort_accesses.csv
+     */
+    void sort_save();
 };
 
 #endif
\ No newline at end of file
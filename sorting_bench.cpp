@@ -0,0 +1,1873 @@
+/**
+ * @file  sorting_bench.cpp
+ *
+ * Headless benchmark for the sorting algorithms of sorting.h. Runs every
+ * selected algorithm on every selected input size and distribution (see
+ * sorting_inputs.h) with a few warmup runs followed by timed repetitions,
+ * and reports the median, 95th percentile, mean, and standard deviation of
+ * the wall time. Nothing is drawn, so the numbers reflect the algorithms
+ * alone. With --perf, hardware counters (see sorting_perf.h) are averaged
+ * over the timed runs as well. With --counts, each case is instead run once
+ * on Counted elements with a counting comparator, and the comparisons,
+ * reads, writes, moves, swaps, and allocations are reported next to their
+ * ratios to n, n log n, and n^2, followed by the model that fits the growth
+ * over the sizes best, and --cache adds the misses of each level of a
+ * simulated cache hierarchy (see sorting_cache.h). The timings can also be
+ * written as JSON or CSV along with the git revision and host (see
+ * sorting_report.h), and --compare tells whether the cases of a new JSON
+ * report regressed against a baseline. --trace writes a Chrome trace of the
+ * recursive calls, partitions, merges, and forks of one more run per case.
+ * --tasks adds the tasks forked by the parallel sorts, their sizes, and
+ * the time spent starting and joining threads. Built together with
+ * sorting_alloc.cpp, it also reports the heap allocations of each case.
+ * --stream first measures the memory bandwidth of the host (see
+ * sorting_stream.h) and then gives the throughput of every case in keys/s
+ * and as bandwidth of one pass over its data. Every input is preceded by
+ * its measures of disorder (see measure_disorder()), which the reports
+ * repeat per case. --cost-cmp, --cost-write, and --cost-indirect time the
+ * sorts as if every comparison, element write, or element read took that
+ * much longer (see SortCosts), e.g. to rank them for keys compared through
+ * storage or for memory that is slow to write.
+ * --scaling sweeps the thread limit of the parallel sorts (see
+ * sort_set_threads()) to report strong and weak scaling, and --simulate
+ * predicts their scaling on more processors than the host has (see
+ * sorting_sim.h). --interfere runs every algorithm alone and then next to
+ * each of the others, as the animator runs its sorts, to find the pairs
+ * that slow each other down. --verify fuzzes every algorithm and checks
+ * that its outputs are sorted, permutations of the inputs (see
+ * multiset_hash()), and stable where claimed. --tune searches the leaf
+ * size, grain size, pivot sample, and radix digit of the sorts for this
+ * host and saves them to the profile that later runs load (see
+ * sorting_tuning.h). Run with --help for the options.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#include "sorting.h"
+#include "sorting_inputs.h"
+#include "sorting_analysis.h"
+#include "sorting_perf.h"
+#include "sorting_report.h"
+#include "sorting_sim.h"
+#include "sorting_cache.h"
+#include "sorting_stream.h"
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <random>
+#include <thread>
+
+
+/***** Registries *****/
+
+/** @brief Sorting algorithm available to the benchmark */
+template <class T>
+struct BenchSort {
+    /** @brief Name used on the command line and in the output */
+    std::string name;
+
+    /** @brief Function to carry out the sort */
+    sort_fn<T> sort;
+
+    /** @brief True if the sort forks threads (see sort_fork()) */
+    bool parallel;
+
+    /** @brief True if the sort keeps equal elements in their order */
+    bool stable;
+};
+
+/** @brief Comparator available to the benchmark */
+template <class T>
+struct BenchCmp {
+    /** @brief Name used on the command line and in the output */
+    std::string name;
+
+    /** @brief One line description for --list */
+    std::string desc;
+
+    /** @brief Comparison function handed to the sorts */
+    cmp_fn<T> cmp;
+};
+
+/**
+ * @brief Returns every algorithm the benchmark knows
+ *
+ * Instantiated for int when timing, for Counted<int> when counting, and
+ * for Tagged when verifying.
+ */
+template <class T>
+std::vector<BenchSort<T>> bench_sorts() {
+    return {
+        { "selection", selection_sort<T>,       false, false },
+        { "insertion", insertion_sort<T>,       false, true  },
+        { "bubble",    bubble_sort<T>,          false, true  },
+        { "merge",     merge_sort<T>,           false, true  },
+        { "pmerge",    pmerge_sort<T>,          true,  true  },
+        { "quick",     quick_sort<T>,           false, false },
+        { "pquick",    pquick_sort<T>,          true,  false },
+        { "rpquick",   rpquick_sort<T>,         true,  false },
+        { "std",       std_sort<T>,             false, false },
+        { "counting",  counting_sort<T>,        false, true  },
+        { "radix",     radix_sort<T>,           false, true  },
+        { "natural",   natural_merge_sort<T>,   false, true  },
+        { "pdq",       pdq_sort<T>,             false, false },
+        { "psample",   psample_sort<T>,         true,  false },
+        { "mergeins",  merge_insertion_sort<T>, false, false },
+        { "cycle",     cycle_sort<T>,           false, false },
+        { "auto",      auto_sort<T>,            false, false },
+    };
+}
+
+/** @brief Returns every comparator the benchmark knows */
+template <class T>
+std::vector<BenchCmp<T>> bench_cmps() {
+    return {
+        { "le", "ascending, x <= y (as in the animator)",
+          [](T& x, T& y) { return x <= y; } },
+        { "ge", "descending, x >= y",
+          [](T& x, T& y) { return x >= y; } },
+    };
+}
+
+
+/***** Options *****/
+
+/** @brief Input distribution and its parameter */
+struct BenchInput {
+    InputDist   dist;
+    size_t      param;
+
+    /** @brief Name for the output, e.g. "nearly:50" */
+    std::string name;
+};
+
+/** @brief Settings of a benchmark run, filled from the command line */
+struct BenchOptions {
+    std::vector<std::string> algos;
+    std::vector<size_t>      sizes;
+    std::vector<BenchInput>  inputs;
+    std::string              cmp;
+    int                      warmup;
+    int                      reps;
+    uint64_t                 seed;
+    bool                     perf;
+
+    /** @brief Probes the memory bandwidth (see stream_probe()) */
+    bool                     stream;
+
+    /** @brief Size of each array of the probe in MiB */
+    size_t                   stream_mb;
+
+    /** @brief Reports the tasks forked by each case (see SortTasks) */
+    bool                     tasks;
+    bool                     counts;
+    bool                     scaling;
+
+    /** @brief Times the algorithms alone and next to each other */
+    bool                     interfere;
+
+    /** @brief Cache hierarchy simulated by --cache (none if empty) */
+    std::vector<CacheConfig> cache;
+
+    /** @brief Thread limits swept by --scaling (default: 1, 2, 4, ...) */
+    std::vector<unsigned>    threads;
+
+    /** @brief Settings of --simulate (see sorting_sim.h) */
+    bool                     simulate;
+    std::vector<int>         procs;
+    std::string              policy;
+    SimCosts                 costs;
+    int                      gantt;
+
+    /** @brief Files to write the results to (none if empty) */
+    std::string              json, csv;
+
+    /** @brief File to write a trace of one run per case to (none if empty) */
+    std::string              trace;
+
+    /**
+     * @brief Costs of comparisons, writes, and reads (see SortCosts)
+     *
+     * When any is set, the cases are timed on Counted elements with a
+     * counting comparator, which pay them.
+     */
+    SortCosts                op_costs;
+
+    /** @brief Fuzzes the algorithms instead of timing them */
+    bool                     verify;
+
+    /** @brief Random cases --verify runs every algorithm on */
+    int                      fuzz;
+
+    /** @brief Searches the parameters of sort_tuning() (see tune()) */
+    bool                     tune;
+
+    /** @brief Profile to load and save (default: sort_tuning_path()) */
+    std::string              profile;
+
+    /** @brief Baseline and new report to compare (none if empty) */
+    std::string              base, next;
+
+    /** @brief Median change in percent flagged by --compare */
+    double                   threshold;
+
+    /** @brief Significance level of --compare */
+    double                   alpha;
+
+    BenchOptions()
+      : sizes({ 1000, 10000 }),
+        inputs({ { InputDist::RANDOM, 0, "random" } }),
+        cmp("le"), warmup(1), reps(5), seed(1), perf(false), stream(false),
+        stream_mb(64), tasks(false),
+        counts(false),
+        scaling(false), interfere(false), simulate(false),
+        procs({ 1, 2, 4, 8, 16, 32, 64 }), policy("both"), gantt(0),
+        verify(false), fuzz(200), tune(false),
+        threshold(5.0), alpha(0.05) {}
+};
+
+/** @brief Splits a comma separated list */
+std::vector<std::string> split(const std::string& s) {
+    std::vector<std::string> parts;
+    size_t i = 0;
+    while (i <= s.size()) {
+        size_t j = s.find(',', i);
+        if (j == std::string::npos)
+            j = s.size();
+        if (j > i)
+            parts.push_back(s.substr(i, j - i));
+        i = j + 1;
+    }
+    return parts;
+}
+
+void usage(const char* prog) {
+    printf("Usage: %s [options]\n"
+           "  --algos a,b,...   algorithms to run (default: all)\n"
+           "  --sizes n,m,...   input sizes (default: 1000,10000)\n"
+           "  --inputs d,...    input distributions, each optionally with a\n"
+           "                    parameter as in nearly:50 (default: random)\n"
+           "  --cmp name        comparator (default: le)\n"
+           "  --warmup w        untimed runs per case (default: 1)\n"
+           "  --reps r          timed runs per case (default: 5)\n"
+           "  --seed s          seed of the inputs (default: 1)\n"
+           "  --perf            count hardware events with perf_event_open\n"
+           "  --stream          measure the memory bandwidth (STREAM copy\n"
+           "                    and triad on 1, 2, 4, ... threads) and\n"
+           "                    report each case against it\n"
+           "  --stream-mb m     MiB per array of --stream (default: 64)\n"
+           "  --cost-cmp ns     time every comparison as if it took ns\n"
+           "                    longer (default: 0)\n"
+           "  --cost-write ns   likewise for every element write\n"
+           "  --cost-indirect ns\n"
+           "                    likewise for every element read\n"
+           "  --tasks           report the tasks forked by parallel sorts:\n"
+           "                    count, sizes, threads, spawn and join time\n"
+           "  --counts          count operations instead of timing, and fit\n"
+           "                    them against n, n log n, and n^2\n"
+           "  --cache [levels]  with --counts, also simulate a cache\n"
+           "                    hierarchy given as size:assoc[:line],...\n"
+           "                    (default: 32k:8,1m:16,8m:16, 64 byte lines)\n"
+           "  --scaling         time the parallel algorithms (or those of\n"
+           "                    --algos) under growing thread limits, at\n"
+           "                    fixed n (strong) and n times threads (weak)\n"
+           "  --interfere       time the parallel algorithms (or those of\n"
+           "                    --algos) alone, next to each other, and\n"
+           "                    next to all others, and report slowdowns\n"
+           "                    and (with --perf) last level cache misses\n"
+           "  --threads t,...   thread limits of --scaling (default: 1, 2,\n"
+           "                    4, ..., and the number of cores)\n"
+           "  --simulate        record the task DAG of the parallel\n"
+           "                    algorithms and replay it on virtual\n"
+           "                    processors (see sorting_sim.h)\n"
+           "  --procs p,...     virtual processors (default: 1, 2, ..., 64)\n"
+           "  --policy name     greedy, steal, or both (default: both)\n"
+           "  --spawn c         cost of a fork (default: 100 accesses)\n"
+           "  --steal c         cost of a steal attempt (default: 50)\n"
+           "  --bandwidth b     processors that can write at full speed at\n"
+           "                    once (default: 0, no limit)\n"
+           "  --gantt p         also draw the schedule on p processors\n"
+           "  --json file       also write the timings as JSON\n"
+           "  --csv file        also write the timings as CSV\n"
+           "  --trace file      also trace one more run per case and write\n"
+           "                    it as a Chrome trace (see sorting_report.h)\n"
+           "  --verify          fuzz the algorithms on random sizes (up to\n"
+           "                    the largest of --sizes), inputs, seeds, and\n"
+           "                    comparators, and check that each output is\n"
+           "                    sorted, a permutation of its input, and\n"
+           "                    stable where the algorithm claims to be\n"
+           "  --fuzz c          random cases of --verify (default: 200)\n"
+           "  --tune            search the leaf size, grain size, pivot\n"
+           "                    sample, and radix digit over --sizes and\n"
+           "                    --inputs, and save them to the profile\n"
+           "  --profile file    tuning profile to load and save, or none\n"
+           "                    (default: $SORT_TUNING or\n"
+           "                    sort_tuning.<host>.json)\n"
+           "  --compare a b     compare two JSON reports instead of running\n"
+           "  --threshold pct   median change in percent flagged by --compare\n"
+           "                    (default: 5)\n"
+           "  --alpha p         significance level of --compare\n"
+           "                    (default: 0.05)\n"
+           "  --list            list algorithms, comparators, and inputs\n"
+           "  --help            show this message\n", prog);
+}
+
+void list() {
+    printf("Algorithms:\n");
+    for (const BenchSort<int>& s : bench_sorts<int>())
+        printf("  %-9s %-8s %s\n", s.name.c_str(),
+               s.parallel ? "parallel" : "", s.stable ? "stable" : "");
+    printf("Comparators:\n");
+    for (const BenchCmp<int>& c : bench_cmps<int>())
+        printf("  %-4s %s\n", c.name.c_str(), c.desc.c_str());
+    printf("Inputs:\n");
+    for (const InputInfo& d : input_dists())
+        printf("  %-9s %s\n", d.name.c_str(), d.desc.c_str());
+}
+
+/**
+ * @brief Parses the command line
+ *
+ * @return 0 to run, 1 to exit successfully, -1 on error
+ */
+int parse(int argc, char** argv, BenchOptions& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (a == "--help") {
+            usage(argv[0]);
+            return 1;
+        } else if (a == "--list") {
+            list();
+            return 1;
+        } else if (a == "--perf") {
+            opt.perf = true;
+        } else if (a == "--tasks") {
+            opt.tasks = true;
+        } else if (a == "--counts") {
+            opt.counts = true;
+        } else if (a == "--scaling") {
+            opt.scaling = true;
+        } else if (a == "--interfere") {
+            opt.interfere = true;
+        } else if (a == "--cache") {
+            opt.cache = cache_default();
+            if (has_value && argv[i + 1][0] != '-'
+                && !cache_parse(argv[++i], 64, opt.cache)) {
+                fprintf(stderr, "Bad cache levels: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (a == "--simulate") {
+            opt.simulate = true;
+        } else if (a == "--stream") {
+            opt.stream = true;
+        } else if (a == "--verify") {
+            opt.verify = true;
+        } else if (a == "--tune") {
+            opt.tune = true;
+        } else if (a == "--compare") {
+            if (i + 2 >= argc) {
+                fprintf(stderr, "--compare needs two files\n");
+                return -1;
+            }
+            opt.base = argv[++i];
+            opt.next = argv[++i];
+        } else if (!has_value) {
+            fprintf(stderr, "Unknown option or missing value: %s\n", argv[i]);
+            return -1;
+        } else if (a == "--algos") {
+            opt.algos = split(argv[++i]);
+        } else if (a == "--sizes") {
+            opt.sizes.clear();
+            for (const std::string& n : split(argv[++i]))
+                opt.sizes.push_back(std::stoul(n));
+        } else if (a == "--inputs") {
+            opt.inputs.clear();
+            for (const std::string& d : split(argv[++i])) {
+                BenchInput in = { InputDist::RANDOM, 0, d };
+                size_t colon = d.find(':');
+                if (colon != std::string::npos)
+                    in.param = std::stoul(d.substr(colon + 1));
+                if (!input_from_name(d.substr(0, colon), in.dist)) {
+                    fprintf(stderr, "Unknown input: %s\n", d.c_str());
+                    return -1;
+                }
+                opt.inputs.push_back(in);
+            }
+        } else if (a == "--cmp") {
+            opt.cmp = argv[++i];
+        } else if (a == "--warmup") {
+            opt.warmup = std::stoi(argv[++i]);
+        } else if (a == "--reps") {
+            opt.reps = std::max(1, std::stoi(argv[++i]));
+        } else if (a == "--seed") {
+            opt.seed = std::stoull(argv[++i]);
+        } else if (a == "--threads") {
+            opt.threads.clear();
+            for (const std::string& t : split(argv[++i]))
+                opt.threads.push_back(std::max(1, std::stoi(t)));
+        } else if (a == "--procs") {
+            opt.procs.clear();
+            for (const std::string& p : split(argv[++i]))
+                opt.procs.push_back(std::max(1, std::stoi(p)));
+        } else if (a == "--policy") {
+            opt.policy = argv[++i];
+            if (opt.policy != "greedy" && opt.policy != "steal"
+                && opt.policy != "both") {
+                fprintf(stderr, "Unknown policy: %s\n", opt.policy.c_str());
+                return -1;
+            }
+        } else if (a == "--spawn") {
+            opt.costs.spawn = std::stod(argv[++i]);
+        } else if (a == "--steal") {
+            opt.costs.steal = std::stod(argv[++i]);
+        } else if (a == "--bandwidth") {
+            opt.costs.bandwidth = std::stod(argv[++i]);
+        } else if (a == "--gantt") {
+            opt.gantt = std::stoi(argv[++i]);
+        } else if (a == "--json") {
+            opt.json = argv[++i];
+        } else if (a == "--csv") {
+            opt.csv = argv[++i];
+        } else if (a == "--trace") {
+            opt.trace = argv[++i];
+        } else if (a == "--stream-mb") {
+            opt.stream_mb = std::max(1, std::stoi(argv[++i]));
+        } else if (a == "--cost-cmp") {
+            opt.op_costs.cmp_ns = std::stoll(argv[++i]);
+        } else if (a == "--cost-write") {
+            opt.op_costs.write_ns = std::stoll(argv[++i]);
+        } else if (a == "--cost-indirect") {
+            opt.op_costs.indirect_ns = std::stoll(argv[++i]);
+        } else if (a == "--fuzz") {
+            opt.fuzz = std::max(1, std::stoi(argv[++i]));
+        } else if (a == "--profile") {
+            opt.profile = argv[++i];
+        } else if (a == "--threshold") {
+            opt.threshold = std::stod(argv[++i]);
+        } else if (a == "--alpha") {
+            opt.alpha = std::stod(argv[++i]);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/***** Measuring *****/
+
+/** @brief Timings of one algorithm on one input */
+struct BenchResult {
+    std::string algo;
+    std::string input;
+    size_t      n;
+
+    /** @brief Peak number of threads working on a run at once */
+    int         threads;
+
+    /**
+     * @brief Time of a serial run, and the time along its critical path
+     *
+     * Taken from an extra run with span tracking, which slows the sort down
+     * somewhat, so their ratio is more telling than their values. Both are
+     * zero unless --scaling, --json, or --csv reports them.
+     */
+    double      work, span;
+
+    /** @brief Wall time of every timed run in seconds */
+    std::vector<double> samples;
+
+    double median, p95, mean, stddev, min;
+
+    /** @brief Hardware counters averaged over the timed runs */
+    PerfCounts perf;
+
+    /** @brief Heap use of the last timed run (see sorting_alloc.cpp) */
+    SortHeap heap;
+
+    /** @brief Tasks forked by the last timed run */
+    SortTasks tasks;
+
+    /** @brief Measures of disorder of the input */
+    Disorder disorder;
+
+    /** @brief Copy bandwidth on the threads of the run (0 without --stream) */
+    double bandwidth;
+
+    /** @brief What the last timed run of auto_sort() saw and picked */
+    SortChoice choice;
+
+    /** @brief Sections of an extra traced run (empty unless --trace) */
+    std::vector<SortTraceEvent> trace;
+
+    /** @brief False if some run did not sort its input */
+    bool ok;
+};
+
+/** @brief Value at quantile q of sorted samples (linear interpolation) */
+double quantile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty())
+        return 0.0;
+    double pos = q * (sorted.size() - 1);
+    size_t i   = (size_t)pos;
+    if (i + 1 >= sorted.size())
+        return sorted.back();
+    return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+}
+
+/** @brief Fills in the summary statistics of a result */
+void summarize(BenchResult& r) {
+    std::vector<double> s = r.samples;
+    std::sort(s.begin(), s.end());
+    r.median = quantile(s, 0.5);
+    r.p95    = quantile(s, 0.95);
+    r.min    = s.front();
+    r.mean   = 0.0;
+    for (double x : s)
+        r.mean += x;
+    r.mean /= s.size();
+    double var = 0.0;
+    for (double x : s)
+        var += (x - r.mean) * (x - r.mean);
+    r.stddev = s.size() > 1 ? std::sqrt(var / (s.size() - 1)) : 0.0;
+}
+
+/** @brief Checks that every adjacent pair is in order under cmp */
+template <class T>
+bool is_sorted_by(std::vector<T>& v, cmp_fn<T>& cmp) {
+    for (size_t i = 1; i < v.size(); i++)
+        if (!cmp(v[i - 1], v[i]))
+            return false;
+    return true;
+}
+
+/** @brief Hash of an int or Counted<int> for multiset_hash(), uncounted */
+template <class T>
+uint64_t value_hash(const T& x) {
+    return (uint64_t)(int64_t)static_cast<const int&>(x);
+}
+
+/**
+ * @brief Times one algorithm on one input
+ *
+ * Instantiated for int, and for Counted<int> when the cases pay a cost
+ * model.
+ */
+template <class T>
+BenchResult run_case(const BenchSort<T>& algo, cmp_fn<T>& cmp,
+                     const BenchInput& in, const std::vector<int>& input,
+                     const BenchOptions& opt) {
+    BenchResult r;
+    r.algo  = algo.name;
+    r.input = in.name;
+    r.n     = input.size();
+    r.ok    = true;
+    r.threads = 0;
+    r.work    = 0.0;
+    r.span    = 0.0;
+    r.bandwidth = 0.0;
+    std::vector<T> v;
+    PerfCounters counters(opt.perf);
+    SortStats stats;
+    uint64_t hash = multiset_hash(input, value_hash<int>);
+    for (int i = 0; i < opt.warmup + opt.reps; i++) {
+        v.assign(input.begin(), input.end());
+        // The counts are not reported: binding gives the thread count and,
+        // with sorting_alloc.cpp, the heap use
+        stats.reset();
+        stats.track(v);
+        sort_bind(&stats);
+        if (opt.perf)
+            counters.start();
+        int64_t t0 = sort_wall_ns();
+        algo.sort(v, cmp);
+        int64_t t1 = sort_wall_ns();
+        sort_bind(NULL);
+        if (i >= opt.warmup) {
+            r.samples.push_back((t1 - t0) * 1e-9);
+            if (opt.perf)
+                r.perf += counters.stop();
+            r.threads = std::max<int>(r.threads, stats.workers_peak);
+            r.heap    = stats.heap();
+            r.tasks   = stats.fork_tasks();
+            r.choice  = stats.chosen();
+        }
+        r.ok = r.ok && is_sorted_by(v, cmp)
+            && multiset_hash(v, value_hash<T>) == hash;
+    }
+
+    // Work and span come from a serial run of their own (see sort_set_span),
+    // made only for the reports that show them
+    if (opt.scaling || !opt.json.empty() || !opt.csv.empty()) {
+        v.assign(input.begin(), input.end());
+        stats.reset();
+        stats.track(v);
+        unsigned limit = sort_thread_limit();
+        sort_set_threads(1);
+        sort_set_span(true);
+        sort_bind(&stats);
+        int64_t t0 = sort_wall_ns();
+        algo.sort(v, cmp);
+        r.work = (sort_wall_ns() - t0) * 1e-9;
+        sort_bind(NULL);
+        sort_set_span(false);
+        sort_set_threads(limit);
+        r.span = stats.span_ns * 1e-9;
+    }
+
+    // So are the traced sections, which add a clock read per call
+    if (!opt.trace.empty()) {
+        SortTrace trace;
+        v.assign(input.begin(), input.end());
+        stats.reset();
+        stats.track(v);
+        stats.trace = &trace;
+        sort_bind(&stats);
+        algo.sort(v, cmp);
+        sort_bind(NULL);
+        stats.trace = NULL;
+        r.trace = trace.take();
+    }
+    for (int e = 0; e < PERF_EVENTS; e++)
+        r.perf.value[e] /= opt.reps;
+    summarize(r);
+    return r;
+}
+
+/** @brief Prints the measures of disorder of an input */
+void print_disorder(const BenchInput& in, size_t n, const Disorder& d) {
+    printf("%-10s %-10s %10zu     %s\n", "disorder", in.name.c_str(), n,
+           format_disorder(d).c_str());
+}
+
+void print_header() {
+    printf("%-10s %-10s %10s %3s %12s %12s %12s %12s %12s\n", "algorithm",
+           "input", "n", "thr", "median", "p95", "mean", "stddev", "min");
+}
+
+void print_result(const BenchResult& r, const BenchOptions& opt) {
+    printf("%-10s %-10s %10zu %3d %12s %12s %12s %12s %12s%s\n",
+           r.algo.c_str(), r.input.c_str(), r.n, r.threads,
+           format_secs(r.median).c_str(), format_secs(r.p95).c_str(),
+           format_secs(r.mean).c_str(), format_secs(r.stddev).c_str(),
+           format_secs(r.min).c_str(), r.ok ? "" : "  NOT SORTED");
+    if (opt.perf)
+        printf("    %s\n", format_perf(r.perf).c_str());
+    if (sort_heap_hooked())
+        printf("    heap %s\n", format_heap(r.heap).c_str());
+    if (opt.tasks && r.tasks.tasks) {
+        printf("    %s\n", format_tasks(r.tasks).c_str());
+        printf("    sizes %s\n", format_task_sizes(r.tasks).c_str());
+    }
+    if (r.choice.engine)
+        printf("    chose %s\n", format_choice(r.choice).c_str());
+    if (opt.stream)
+        printf("    %s\n", format_roofline(r.n, sizeof(int), r.median,
+                                            r.bandwidth).c_str());
+    fflush(stdout);
+}
+
+
+/***** Reports *****/
+
+/**
+ * @brief Writes the timings and their context as JSON
+ *
+ * Every result keeps its raw samples so that --compare can test them.
+ */
+bool write_json(const std::string& path, const ReportHost& host,
+                const BenchOptions& opt, const std::vector<BenchResult>& rs) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    fprintf(f, "{\n  \"host\": %s,\n", json_host(host).c_str());
+    const SortTuning& t = sort_tuning();
+    fprintf(f, "  \"config\": {\"comparator\": %s, \"warmup\": %d, "
+               "\"reps\": %d, \"seed\": %llu,\n"
+               "             \"tuning\": {\"leaf\": %zu, \"grain\": %zu, "
+               "\"pivot_sample\": %zu, \"radix_bits\": %zu},\n"
+               "             \"costs\": {\"cmp_ns\": %lld, \"write_ns\": %lld, "
+               "\"indirect_ns\": %lld}},\n",
+            json_quote(opt.cmp).c_str(), opt.warmup, opt.reps,
+            (unsigned long long)opt.seed, t.leaf, t.grain, t.pivot_sample,
+            t.radix_bits, (long long)opt.op_costs.cmp_ns,
+            (long long)opt.op_costs.write_ns,
+            (long long)opt.op_costs.indirect_ns);
+    fprintf(f, "  \"results\": [");
+    for (size_t i = 0; i < rs.size(); i++) {
+        const BenchResult& r = rs[i];
+        fprintf(f, "%s\n    {\"algo\": %s, \"input\": %s, \"n\": %zu, "
+                   "\"threads\": %d, \"ok\": %s,\n",
+                i ? "," : "", json_quote(r.algo).c_str(),
+                json_quote(r.input).c_str(), r.n, r.threads,
+                r.ok ? "true" : "false");
+        fprintf(f, "     \"work\": %s, \"span\": %s,\n",
+                json_number(r.work).c_str(), json_number(r.span).c_str());
+        fprintf(f, "     \"median\": %s, \"p95\": %s, \"mean\": %s, "
+                   "\"stddev\": %s, \"min\": %s,\n",
+                json_number(r.median).c_str(), json_number(r.p95).c_str(),
+                json_number(r.mean).c_str(), json_number(r.stddev).c_str(),
+                json_number(r.min).c_str());
+        fprintf(f, "     \"samples\": [");
+        for (size_t k = 0; k < r.samples.size(); k++)
+            fprintf(f, "%s%s", k ? ", " : "",
+                    json_number(r.samples[k]).c_str());
+        fprintf(f, "],\n     \"perf\": {");
+        bool first = true;
+        for (int e = 0; e < PERF_EVENTS; e++) {
+            if (!r.perf.valid[e])
+                continue;
+            fprintf(f, "%s\"%s\": %llu", first ? "" : ", ",
+                    perf_name((PerfEvent)e),
+                    (unsigned long long)r.perf.value[e]);
+            first = false;
+        }
+        fprintf(f, "}");
+        if (opt.tasks) {
+            const SortTasks& t = r.tasks;
+            fprintf(f, ",\n     \"tasks\": {\"tasks\": %llu, "
+                       "\"spawned\": %llu, \"peak\": %d, \"elems\": %llu, "
+                       "\"spawn\": %s, \"join\": %s, \"sizes\": [",
+                    (unsigned long long)t.tasks,
+                    (unsigned long long)t.spawned, t.peak,
+                    (unsigned long long)t.elems,
+                    json_number(t.spawn_ns * 1e-9).c_str(),
+                    json_number(t.join_ns * 1e-9).c_str());
+            for (int b = 0; b < SORT_SIZE_BUCKETS; b++)
+                fprintf(f, "%s%llu", b ? ", " : "",
+                        (unsigned long long)t.sizes[b]);
+            fprintf(f, "]}");
+        }
+        if (sort_heap_hooked())
+            fprintf(f, ",\n     \"heap\": {\"allocs\": %llu, \"frees\": %llu, "
+                       "\"bytes\": %llu, \"peak\": %lld, \"threads\": %d}",
+                    (unsigned long long)r.heap.allocs,
+                    (unsigned long long)r.heap.frees,
+                    (unsigned long long)r.heap.bytes,
+                    (long long)r.heap.peak, r.heap.threads);
+        if (r.choice.engine)
+            fprintf(f, ",\n     \"choice\": {\"engine\": %s, "
+                       "\"sorted\": %s, \"runs\": %zu, \"dups\": %s, "
+                       "\"key_order\": %d, \"threads\": %u}",
+                    json_quote(r.choice.engine).c_str(),
+                    json_number(r.choice.sorted).c_str(), r.choice.runs,
+                    json_number(r.choice.dups).c_str(), r.choice.key_order,
+                    r.choice.threads);
+        if (opt.stream && r.median > 0.0)
+            fprintf(f, ",\n     \"roofline\": {\"keys_per_s\": %s, "
+                       "\"pass_bw\": %s, \"copy_bw\": %s}",
+                    json_number(r.n / r.median).c_str(),
+                    json_number(2.0 * r.n * sizeof(int) / r.median).c_str(),
+                    json_number(r.bandwidth).c_str());
+        const Disorder& d = r.disorder;
+        fprintf(f, ",\n     \"disorder\": {\"runs\": %zu, "
+                   "\"inversions\": %llu, \"rem\": %zu, \"max\": %zu, "
+                   "\"osc\": %llu, \"dups\": %s}",
+                d.runs, (unsigned long long)d.inversions, d.rem, d.max,
+                (unsigned long long)d.osc, json_number(d.dups).c_str());
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+/**
+ * @brief Writes the timings as CSV, one row per case
+ *
+ * The context is repeated on every row so that files from several hosts or
+ * revisions can simply be concatenated. Counters that were not available
+ * are left empty.
+ */
+bool write_csv(const std::string& path, const ReportHost& host,
+               const BenchOptions& opt, const std::vector<BenchResult>& rs) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    fprintf(f, "git,host,isa,comparator,algo,input,n,threads,ok,median_s,"
+               "p95_s,mean_s,stddev_s,min_s,work_s,span_s");
+    for (int e = 0; e < PERF_EVENTS; e++)
+        fprintf(f, ",%s", perf_name((PerfEvent)e));
+    fprintf(f, ",runs,inversions,rem,max,osc,dups\n");
+    for (const BenchResult& r : rs) {
+        fprintf(f, "%s,%s,%s,%s,%s,%s,%zu,%d,%d,%.9g,%.9g,%.9g,%.9g,%.9g,"
+                   "%.9g,%.9g", host.git.c_str(), host.host.c_str(),
+                host.isa.c_str(), opt.cmp.c_str(), r.algo.c_str(),
+                r.input.c_str(), r.n, r.threads, r.ok ? 1 : 0, r.median,
+                r.p95, r.mean, r.stddev, r.min, r.work, r.span);
+        for (int e = 0; e < PERF_EVENTS; e++) {
+            if (r.perf.valid[e])
+                fprintf(f, ",%llu", (unsigned long long)r.perf.value[e]);
+            else
+                fprintf(f, ",");
+        }
+        const Disorder& d = r.disorder;
+        fprintf(f, ",%zu,%llu,%zu,%zu,%llu,%.6g\n", d.runs,
+                (unsigned long long)d.inversions, d.rem, d.max,
+                (unsigned long long)d.osc, d.dups);
+    }
+    return fclose(f) == 0;
+}
+
+/** @brief Key identifying a case across reports, e.g. "merge random 1000" */
+std::string report_key(const JsonValue& r) {
+    return r["algo"].text() + " " + r["input"].text() + " "
+         + std::to_string((size_t)r["n"].num());
+}
+
+/** @brief Raw samples of a case of a report */
+std::vector<double> report_samples(const JsonValue& r) {
+    std::vector<double> s;
+    for (const JsonValue& x : r["samples"].items)
+        s.push_back(x.num());
+    return s;
+}
+
+/**
+ * @brief Compares the cases two JSON reports have in common
+ *
+ * A case regressed (or improved) if its median changed by more than the
+ * threshold and the Mann-Whitney test finds the samples different at the
+ * significance level.
+ *
+ * @return 0 if nothing regressed, 1 if something did, 2 on error
+ */
+int compare(const BenchOptions& opt) {
+    JsonValue base, next;
+    for (const std::string* path : { &opt.base, &opt.next }) {
+        if (!read_json(*path, path == &opt.base ? base : next)) {
+            fprintf(stderr, "Cannot read report %s\n", path->c_str());
+            return 2;
+        }
+    }
+    const JsonValue& bh = base["host"];
+    const JsonValue& nh = next["host"];
+    printf("base %s (%s, %s)\nnew  %s (%s, %s)\n",
+           bh["git"].text("?").c_str(), bh["host"].text("?").c_str(),
+           bh["isa"].text("?").c_str(), nh["git"].text("?").c_str(),
+           nh["host"].text("?").c_str(), nh["isa"].text("?").c_str());
+    if (bh["host"].text() != nh["host"].text()
+        || bh["cpu"].text() != nh["cpu"].text())
+        printf("warning: the reports come from different machines\n");
+    printf("%-10s %-10s %10s %12s %12s %8s %8s\n", "algorithm", "input", "n",
+           "base", "new", "change", "p");
+
+    int regressions = 0, matched = 0;
+    for (const JsonValue& b : base["results"].items) {
+        const JsonValue* n = NULL;
+        for (const JsonValue& r : next["results"].items)
+            if (report_key(r) == report_key(b))
+                n = &r;
+        if (!n)
+            continue;
+        matched++;
+        double bm = b["median"].num(), nm = (*n)["median"].num();
+        double change = bm > 0.0 ? (nm / bm - 1.0) * 100.0 : 0.0;
+        double p = mann_whitney_p(report_samples(b), report_samples(*n));
+        const char* verdict = "";
+        if (p < opt.alpha && change > opt.threshold) {
+            verdict = "  REGRESSION";
+            regressions++;
+        } else if (p < opt.alpha && change < -opt.threshold) {
+            verdict = "  improved";
+        }
+        printf("%-10s %-10s %10zu %12s %12s %+7.1f%% %8.3f%s\n",
+               b["algo"].text().c_str(), b["input"].text().c_str(),
+               (size_t)b["n"].num(), format_secs(bm).c_str(),
+               format_secs(nm).c_str(), change, p, verdict);
+    }
+    printf("%d cases compared, %d regressed by more than %.1f%% "
+           "(p < %.3g)\n", matched, regressions, opt.threshold, opt.alpha);
+    return regressions ? 1 : 0;
+}
+
+
+/***** Counting *****/
+
+/** @brief Operation counts of one algorithm on one input */
+struct CountResult {
+    std::string algo;
+    std::string input;
+    size_t      n;
+    uint64_t    comparisons, reads, writes, moves, swaps, allocs, aux_peak;
+
+    /** @brief Misses of each level of the simulated cache, if any */
+    std::string cache;
+
+    /** @brief False if the output is not a sorted permutation of the input */
+    bool ok;
+};
+
+/**
+ * @brief Counts the operations of one run of one algorithm on one input
+ *
+ * @param[in] levels  Cache hierarchy to run the accesses through, or empty
+ */
+CountResult count_case(const BenchSort<Counted<int>>& algo,
+                       cmp_fn<Counted<int>>& cmp, const BenchInput& in,
+                       const std::vector<int>& input,
+                       const std::vector<CacheConfig>& levels) {
+    std::vector<Counted<int>> v(input.begin(), input.end());
+    SortStats stats;
+    stats.reset();
+    CacheSim cache(levels);
+    if (!levels.empty())
+        stats.watches.push_back(&cache);
+    sort_bind(&stats);
+    stats.start();
+    algo.sort(v, counting_cmp(cmp));
+    stats.stop();
+    sort_bind(NULL);
+
+    CountResult r;
+    r.algo        = algo.name;
+    r.input       = in.name;
+    r.n           = input.size();
+    r.comparisons = stats.comparisons;
+    r.reads       = stats.reads;
+    r.writes      = stats.writes;
+    r.moves       = stats.moves;
+    r.swaps       = stats.swaps;
+    r.allocs      = stats.allocs;
+    r.aux_peak    = stats.aux_peak;
+    r.ok          = is_sorted_by(v, cmp)
+                 && multiset_hash(v, value_hash<Counted<int>>)
+                    == multiset_hash(input, value_hash<int>);
+    if (!levels.empty())
+        r.cache = format_cache(cache);
+    return r;
+}
+
+/** @brief Growth models the counts are fitted against */
+const int COUNT_MODELS = 3;
+const char* const COUNT_MODEL_NAMES[COUNT_MODELS] = { "n", "n log n", "n^2" };
+
+/** @brief Value of a growth model at n (log base 2) */
+double count_model(int m, size_t n) {
+    double x = (double)std::max<size_t>(n, 2);
+    return m == 0 ? x : m == 1 ? x * std::log2(x) : x * x;
+}
+
+/**
+ * @brief Fits counts measured at several sizes
+ *
+ * Picks the model under which count / model(n) varies least, relative to its
+ * mean, and estimates the exponent of n from a least squares fit of
+ * log(count) against log(n).
+ *
+ * @param[out] coef   Mean of count / model(n) under the chosen model
+ * @param[out] slope  Fitted exponent of n
+ * @return Index of the chosen model, -1 with fewer than two nonzero counts
+ */
+int count_fit(const std::vector<size_t>& n, const std::vector<double>& count,
+              double& coef, double& slope) {
+    std::vector<double> lx, ly;
+    for (size_t i = 0; i < n.size(); i++) {
+        if (n[i] > 1 && count[i] > 0) {
+            lx.push_back(std::log((double)n[i]));
+            ly.push_back(std::log(count[i]));
+        }
+    }
+    if (lx.size() < 2)
+        return -1;
+    double mx = 0.0, my = 0.0, sxy = 0.0, sxx = 0.0;
+    for (size_t i = 0; i < lx.size(); i++) {
+        mx += lx[i] / lx.size();
+        my += ly[i] / ly.size();
+    }
+    for (size_t i = 0; i < lx.size(); i++) {
+        sxy += (lx[i] - mx) * (ly[i] - my);
+        sxx += (lx[i] - mx) * (lx[i] - mx);
+    }
+    slope = sxx > 0.0 ? sxy / sxx : 0.0;
+
+    int best = -1;
+    double best_cv = 0.0;
+    for (int m = 0; m < COUNT_MODELS; m++) {
+        std::vector<double> ratio;
+        for (size_t i = 0; i < n.size(); i++)
+            if (n[i] > 1 && count[i] > 0)
+                ratio.push_back(count[i] / count_model(m, n[i]));
+        double mean = 0.0, var = 0.0;
+        for (double r : ratio)
+            mean += r / ratio.size();
+        for (double r : ratio)
+            var += (r - mean) * (r - mean) / ratio.size();
+        double cv = std::sqrt(var) / mean;
+        if (best < 0 || cv < best_cv) {
+            best    = m;
+            best_cv = cv;
+            coef    = mean;
+        }
+    }
+    return best;
+}
+
+void print_count_header() {
+    printf("%-10s %-10s %10s %9s %9s %9s %9s %9s %6s %9s %9s %9s\n",
+           "algorithm", "input", "n", "cmp", "reads", "writes", "moves",
+           "swaps", "allocs", "cmp/n", "cmp/nlgn", "cmp/n^2");
+}
+
+void print_count(const CountResult& r) {
+    double c = (double)r.comparisons;
+    printf("%-10s %-10s %10zu %9s %9s %9s %9s %9s %6llu %9.3g %9.3g %9.3g"
+           "%s\n", r.algo.c_str(), r.input.c_str(), r.n,
+           format_count(c).c_str(), format_count(r.reads).c_str(),
+           format_count(r.writes).c_str(), format_count(r.moves).c_str(),
+           format_count(r.swaps).c_str(), (unsigned long long)r.allocs,
+           c / count_model(0, r.n), c / count_model(1, r.n),
+           c / count_model(2, r.n), r.ok ? "" : "  NOT SORTED");
+    if (!r.cache.empty())
+        printf("%21s %s\n", "", r.cache.c_str());
+    fflush(stdout);
+}
+
+/** @brief Prints the fitted growth of comparisons and of data movement */
+void print_count_fit(const std::vector<CountResult>& rs) {
+    std::vector<size_t> n;
+    std::vector<double> cmp, data;
+    for (const CountResult& r : rs) {
+        n.push_back(r.n);
+        cmp.push_back((double)r.comparisons);
+        data.push_back((double)(r.writes + r.moves));
+    }
+    printf("%-10s %-10s", rs[0].algo.c_str(), rs[0].input.c_str());
+    const char* what[2] = { "cmp", "writes+moves" };
+    const std::vector<double>* counts[2] = { &cmp, &data };
+    for (int k = 0; k < 2; k++) {
+        double coef = 0.0, slope = 0.0;
+        int m = count_fit(n, *counts[k], coef, slope);
+        if (m < 0)
+            printf("  %s: too few nonzero counts", what[k]);
+        else
+            printf("  %s ~ %.3g %-7s (n^%.2f)", what[k], coef,
+                   COUNT_MODEL_NAMES[m], slope);
+    }
+    printf("\n");
+}
+
+/** @brief Runs the benchmark in counting mode */
+bool run_counts(const BenchOptions& opt,
+                const std::vector<BenchSort<Counted<int>>>& algos,
+                BenchCmp<Counted<int>>& cmp) {
+    printf("comparator %s, operation counts of one run per case, seed %llu\n",
+           cmp.name.c_str(), (unsigned long long)opt.seed);
+    print_count_header();
+    bool ok = true;
+    std::vector<std::vector<CountResult>> fits;
+    for (const BenchInput& in : opt.inputs) {
+        size_t first = fits.size();
+        fits.resize(first + algos.size());
+        for (size_t n : opt.sizes) {
+            std::vector<int> input = generate_input(in.dist, n, opt.seed,
+                                                    in.param);
+            print_disorder(in, n, measure_disorder(input));
+            for (size_t a = 0; a < algos.size(); a++) {
+                CountResult r = count_case(algos[a], cmp.cmp, in, input,
+                                           opt.cache);
+                print_count(r);
+                // A sort that lost or made up elements has nothing to fit
+                if (r.ok)
+                    fits[first + a].push_back(r);
+                ok = ok && r.ok;
+            }
+        }
+    }
+    printf("\nGrowth (best fitting model, coefficient, fitted exponent):\n");
+    for (const std::vector<CountResult>& rs : fits)
+        if (!rs.empty())
+            print_count_fit(rs);
+    return ok;
+}
+
+
+/***** Scaling *****/
+
+/**
+ * @brief Thread limits to sweep, always starting with 1
+ *
+ * Defaults to the powers of two below the number of cores, then the number
+ * of cores itself.
+ */
+std::vector<unsigned> scaling_threads(const BenchOptions& opt) {
+    std::vector<unsigned> t = opt.threads;
+    if (t.empty()) {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned p = 1; p < cores; p *= 2)
+            t.push_back(p);
+        t.push_back(cores);
+    }
+    t.push_back(1);
+    std::sort(t.begin(), t.end());
+    t.erase(std::unique(t.begin(), t.end()), t.end());
+    return t;
+}
+
+/**
+ * @brief Karp-Flatt metric: serial fraction implied by a speedup
+ *
+ * @pre p > 1 (the metric is undefined for a single thread)
+ */
+double karp_flatt(double speedup, unsigned p) {
+    if (speedup <= 0.0)
+        return 1.0;
+    return (1.0 / speedup - 1.0 / p) / (1.0 - 1.0 / p);
+}
+
+void print_scaling_header() {
+    printf("%-10s %-10s %-6s %10s %5s %4s %12s %12s %12s %7s %8s %6s %6s\n",
+           "algorithm", "input", "mode", "n", "limit", "thr", "median",
+           "work", "span", "par", "speedup", "eff", "kf");
+}
+
+/**
+ * @brief Times the algorithms under every thread limit
+ *
+ * Strong scaling keeps n fixed, so speedup is T(1) / T(p). Weak scaling
+ * sorts p times as many elements with p threads and reports the scaled
+ * speedup p T(1) / T(p); as the sorts do O(n log n) work rather than O(n),
+ * even perfect weak scaling falls slightly short of an efficiency of 1.
+ * Efficiency is speedup / p, and the Karp-Flatt metric estimates the serial
+ * fraction that would explain the speedup (roughly constant if the serial
+ * parts limit scaling, growing with p if overhead does).
+ *
+ * Next to them are the work (time of a serial run), the span (time along
+ * the critical path of the forks in that run), and their ratio, the
+ * parallelism: the speedup the algorithm itself would allow on unlimited
+ * threads. A speedup far below min(p, parallelism) points at the runtime
+ * (thread creation, oversubscription, memory bandwidth) rather than at the
+ * algorithm.
+ */
+bool run_scaling(const BenchOptions& opt,
+                 const std::vector<BenchSort<int>>& algos, BenchCmp<int>& cmp) {
+    std::vector<unsigned> threads = scaling_threads(opt);
+    printf("comparator %s, %d warmup + %d timed runs, seed %llu, %u cores\n",
+           cmp.name.c_str(), opt.warmup, opt.reps,
+           (unsigned long long)opt.seed, std::thread::hardware_concurrency());
+    print_scaling_header();
+    bool ok = true;
+    for (bool weak : { false, true }) {
+        for (const BenchInput& in : opt.inputs) {
+            for (size_t n : opt.sizes) {
+                for (const BenchSort<int>& algo : algos) {
+                    double t1 = 0.0;
+                    for (unsigned p : threads) {
+                        size_t m = weak ? n * p : n;
+                        std::vector<int> input =
+                            generate_input(in.dist, m, opt.seed, in.param);
+                        sort_set_threads(p);
+                        BenchResult r = run_case(algo, cmp.cmp, in, input,
+                                                 opt);
+                        sort_set_threads(0);
+                        if (p == 1)
+                            t1 = r.median;
+                        double speedup = r.median > 0.0
+                                       ? (weak ? p : 1) * t1 / r.median
+                                       : 0.0;
+                        char kf[16] = "-";
+                        if (p > 1)
+                            snprintf(kf, sizeof(kf), "%.3f",
+                                     karp_flatt(speedup, p));
+                        printf("%-10s %-10s %-6s %10zu %5u %4d %12s %12s "
+                               "%12s %7.2f %8.2f %6.2f %6s%s\n",
+                               r.algo.c_str(), r.input.c_str(),
+                               weak ? "weak" : "strong", m, p, r.threads,
+                               format_secs(r.median).c_str(),
+                               format_secs(r.work).c_str(),
+                               format_secs(r.span).c_str(),
+                               r.span > 0.0 ? r.work / r.span : 0.0,
+                               speedup, speedup / p, kf,
+                               r.ok ? "" : "  NOT SORTED");
+                        fflush(stdout);
+                        ok = ok && r.ok;
+                    }
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+
+/***** Interference *****/
+
+/** @brief Runs of one sort while others sort next to it */
+struct CoRun {
+    /** @brief Wall time of every timed run in seconds */
+    std::vector<double> samples;
+
+    double median;
+
+    /** @brief Hardware counters of the sort, averaged over the timed runs */
+    PerfCounts perf;
+
+    /** @brief False if some run did not sort its input */
+    bool ok;
+};
+
+/**
+ * @brief Times a sort while each of the others sorts its own copy of the
+ *        input over and over on a thread of its own
+ *
+ * The others start first and keep going until every run of the timed sort
+ * is over, so that each of its runs (warmup included) competes with all of
+ * them for the cores, the caches, and the memory bandwidth. The counters
+ * are only opened with --perf, and then after the others have started, so
+ * that they count the timed sort and the threads it forks alone.
+ */
+CoRun co_run(const BenchSort<int>& victim,
+             const std::vector<const BenchSort<int>*>& others,
+             cmp_fn<int>& cmp, const std::vector<int>& input,
+             const BenchOptions& opt) {
+    std::atomic<bool> done(false);
+    std::atomic<size_t> ready(0);
+    std::vector<std::thread> pool;
+    for (const BenchSort<int>* other : others) {
+        pool.push_back(std::thread([&, other]() {
+            std::vector<int> v;
+            SortStats stats;
+            sort_bind(&stats);
+            ready++;
+            while (!done) {
+                v = input;
+                other->sort(v, cmp);
+            }
+            sort_bind(NULL);
+        }));
+    }
+    while (ready < others.size())
+        std::this_thread::yield();
+
+    CoRun r;
+    r.ok = true;
+    std::vector<int> v;
+    SortStats stats;
+    PerfCounters counters(opt.perf);
+    uint64_t hash = multiset_hash(input, value_hash<int>);
+    for (int i = 0; i < opt.warmup + opt.reps; i++) {
+        v = input;
+        stats.reset();
+        sort_bind(&stats);
+        if (opt.perf)
+            counters.start();
+        int64_t t0 = sort_wall_ns();
+        victim.sort(v, cmp);
+        int64_t t1 = sort_wall_ns();
+        sort_bind(NULL);
+        if (i >= opt.warmup) {
+            r.samples.push_back((t1 - t0) * 1e-9);
+            if (opt.perf)
+                r.perf += counters.stop();
+        }
+        r.ok = r.ok && is_sorted_by(v, cmp)
+            && multiset_hash(v, value_hash<int>) == hash;
+    }
+    done = true;
+    for (std::thread& t : pool)
+        t.join();
+
+    for (int e = 0; e < PERF_EVENTS; e++)
+        r.perf.value[e] /= opt.reps;
+    std::vector<double> sorted = r.samples;
+    std::sort(sorted.begin(), sorted.end());
+    r.median = quantile(sorted, 0.5);
+    return r;
+}
+
+/**
+ * @brief Prints one matrix of the interference report, a row per sort and
+ *        a column per neighbour (and one for all of them)
+ *
+ * @param[in] cell  Text of the cell of a sort and the run next to a
+ *                  neighbour (column algos.size() for all of them)
+ */
+void print_interference(const char* title,
+                        const std::vector<BenchSort<int>>& algos,
+                        std::function<std::string(size_t, size_t)> cell) {
+    printf("%-10s", title);
+    for (const BenchSort<int>& a : algos)
+        printf(" %10s", a.name.c_str());
+    printf(" %10s\n", "all");
+    for (size_t i = 0; i < algos.size(); i++) {
+        printf("%-10s", algos[i].name.c_str());
+        for (size_t j = 0; j <= algos.size(); j++)
+            printf(" %10s", cell(i, j).c_str());
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief Times every algorithm alone, next to each algorithm (itself
+ *        included), and next to all the others at once
+ *
+ * The slowdown of a sort next to a neighbour is its median time there over
+ * its median time alone; the matrix need not be symmetric, as a sort that
+ * streams through memory can hurt a neighbour that relies on its cache
+ * without suffering much itself. With hardware counters, the last level
+ * cache misses of each sort tell whether it lost its share of the cache
+ * (the misses grow) and, counted as 64 byte lines over its time, how much
+ * memory bandwidth it drew; a sort that slows down with as many misses as
+ * alone is waiting for the cores rather than for memory.
+ */
+bool run_interference(const BenchOptions& opt,
+                      const std::vector<BenchSort<int>>& algos,
+                      BenchCmp<int>& cmp) {
+    printf("comparator %s, %d warmup + %d timed runs, seed %llu, %u cores\n",
+           cmp.name.c_str(), opt.warmup, opt.reps,
+           (unsigned long long)opt.seed, std::thread::hardware_concurrency());
+    const int llc = (int)PerfEvent::LLC_MISSES;
+    const double LINE = 64.0;
+    bool ok = true;
+    for (const BenchInput& in : opt.inputs) {
+        for (size_t n : opt.sizes) {
+            std::vector<int> input = generate_input(in.dist, n, opt.seed,
+                                                    in.param);
+            printf("\n%s, n = %zu\n", in.name.c_str(), n);
+            // runs[i][j]: sort i next to sort j, or all others for j = k
+            size_t k = algos.size();
+            std::vector<CoRun> alone;
+            std::vector<std::vector<CoRun>> runs(k);
+            for (size_t i = 0; i < k; i++) {
+                alone.push_back(co_run(algos[i], {}, cmp.cmp, input, opt));
+                std::vector<const BenchSort<int>*> all;
+                for (size_t j = 0; j < k; j++) {
+                    runs[i].push_back(co_run(algos[i], { &algos[j] },
+                                             cmp.cmp, input, opt));
+                    if (j != i)
+                        all.push_back(&algos[j]);
+                }
+                runs[i].push_back(co_run(algos[i], all, cmp.cmp, input,
+                                         opt));
+                ok = ok && alone[i].ok;
+                for (const CoRun& r : runs[i])
+                    ok = ok && r.ok;
+            }
+
+            bool perf = k && alone[0].perf.valid[llc];
+            printf("%-10s %10s", "alone", "median");
+            if (perf)
+                printf(" %10s %10s", "llc miss", "llc bw");
+            printf("\n");
+            for (size_t i = 0; i < k; i++) {
+                printf("%-10s %10s", algos[i].name.c_str(),
+                       format_secs(alone[i].median).c_str());
+                if (alone[i].perf.valid[llc]) {
+                    double misses = (double)alone[i].perf.value[llc];
+                    printf(" %10s %10s", format_count(misses).c_str(),
+                           format_bandwidth(alone[i].median > 0.0
+                               ? misses * LINE / alone[i].median
+                               : 0.0).c_str());
+                }
+                printf("%s\n", alone[i].ok ? "" : "  NOT SORTED");
+            }
+            print_interference("slowdown", algos, [&](size_t i, size_t j) {
+                char buf[16];
+                snprintf(buf, sizeof(buf), "%.2fx", alone[i].median > 0.0
+                         ? runs[i][j].median / alone[i].median : 0.0);
+                return std::string(buf);
+            });
+            if (!perf) {
+                printf("llc misses n/a (see --perf)\n");
+                continue;
+            }
+            print_interference("llc miss", algos, [&](size_t i, size_t j) {
+                char buf[16];
+                uint64_t a = alone[i].perf.value[llc];
+                snprintf(buf, sizeof(buf), "%+.0f%%", a
+                         ? 100.0 * runs[i][j].perf.value[llc] / a - 100.0
+                         : 0.0);
+                return std::string(buf);
+            });
+            print_interference("llc bw", algos, [&](size_t i, size_t j) {
+                const CoRun& r = runs[i][j];
+                return format_bandwidth(r.median > 0.0
+                    ? r.perf.value[llc] * LINE / r.median : 0.0);
+            });
+        }
+    }
+    return ok;
+}
+
+
+/***** Simulation *****/
+
+/** @brief Records the task DAG of one run of an algorithm */
+std::vector<SimTask> record_dag(const BenchSort<Counted<int>>& algo,
+                                cmp_fn<Counted<int>>& cmp,
+                                const std::vector<int>& input, bool& ok) {
+    std::vector<Counted<int>> v(input.begin(), input.end());
+    SimRecorder recorder;
+    SortStats stats;
+    stats.reset();
+    stats.watches = { &recorder };
+    unsigned limit = sort_thread_limit();
+    sort_set_threads(1);
+    sort_bind(&stats);
+    algo.sort(v, counting_cmp(cmp));
+    sort_bind(NULL);
+    sort_set_threads(limit);
+    ok = is_sorted_by(v, cmp);
+    return recorder.tasks;
+}
+
+/**
+ * @brief Predicts the speedup of the algorithms on virtual processors
+ *
+ * Times are in accesses (see SimCosts). Speedup is relative to the same
+ * policy on one processor, which pays for spawning too; "bound" is the
+ * most speedup the DAG allows on p processors, work / max(work / p, span).
+ */
+bool run_simulation(const BenchOptions& opt,
+                    const std::vector<BenchSort<Counted<int>>>& algos,
+                    BenchCmp<Counted<int>>& cmp) {
+    std::vector<SimPolicy> policies;
+    if (opt.policy != "steal")
+        policies.push_back(SimPolicy::GREEDY);
+    if (opt.policy != "greedy")
+        policies.push_back(SimPolicy::STEAL);
+    printf("comparator %s, seed %llu, spawn %g, steal %g, bandwidth %g\n",
+           cmp.name.c_str(), (unsigned long long)opt.seed, opt.costs.spawn,
+           opt.costs.steal, opt.costs.bandwidth);
+    printf("%-10s %-10s %10s %-6s %5s %10s %8s %6s %8s %9s %8s\n",
+           "algorithm", "input", "n", "policy", "procs", "time", "speedup",
+           "eff", "bound", "overhead", "steals");
+    bool ok = true;
+    for (const BenchInput& in : opt.inputs) {
+        for (size_t n : opt.sizes) {
+            std::vector<int> input = generate_input(in.dist, n, opt.seed,
+                                                    in.param);
+            for (const BenchSort<Counted<int>>& algo : algos) {
+                bool sorted;
+                std::vector<SimTask> dag = record_dag(algo, cmp.cmp, input,
+                                                      sorted);
+                ok = ok && sorted;
+                for (SimPolicy policy : policies) {
+                    const char* name = policy == SimPolicy::GREEDY ? "greedy"
+                                                                  : "steal";
+                    double t1 = simulate(dag, 1, policy, opt.costs).makespan;
+                    for (int p : opt.procs) {
+                        SimResult r = simulate(dag, p, policy, opt.costs,
+                                               p == opt.gantt);
+                        double speedup = r.makespan > 0.0
+                                       ? t1 / r.makespan : 0.0;
+                        double bound = r.work
+                                     / std::max(r.work / p, r.span);
+                        printf("%-10s %-10s %10zu %-6s %5d %10s %8.2f %6.2f "
+                               "%8.2f %8.1f%% %8llu%s\n", algo.name.c_str(),
+                               in.name.c_str(), n, name, p,
+                               format_count(r.makespan).c_str(), speedup,
+                               speedup / p, bound,
+                               100.0 * r.overhead / (p * r.makespan),
+                               (unsigned long long)r.steals,
+                               sorted ? "" : "  NOT SORTED");
+                        if (p == opt.gantt)
+                            printf("%s", sim_gantt(r).c_str());
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+
+/***** Tuning *****/
+
+/** @brief Algorithms whose time decides a parameter of sort_tuning() */
+std::vector<std::string> tune_algos(const TuneParam& p) {
+    std::string name = p.name;
+    if (name == "leaf")
+        return { "merge", "quick" };
+    if (name == "grain")
+        return { "pmerge", "pquick" };
+    if (name == "radix_bits")
+        return { "radix" };
+    return { "quick", "pquick" };
+}
+
+/**
+ * @brief Searches sort_tuning() from its current values and saves it
+ *
+ * A setting costs the sum of the median times of the algorithms that use
+ * the parameter being moved, over every size and input of the options. Only
+ * the algorithms of --algos count, if given.
+ */
+bool run_tuning(const BenchOptions& opt, BenchCmp<int>& cmp) {
+    std::vector<std::pair<BenchInput, std::vector<int>>> inputs;
+    for (const BenchInput& in : opt.inputs)
+        for (size_t n : opt.sizes)
+            inputs.push_back({ in, generate_input(in.dist, n, opt.seed,
+                                                  in.param) });
+    std::vector<BenchSort<int>> all = bench_sorts<int>();
+    bool ok = true;
+
+    auto cost = [&](const SortTuning& t, const TuneParam& p) {
+        sort_tuning() = t;
+        double total = 0.0;
+        for (const std::string& name : tune_algos(p)) {
+            if (!opt.algos.empty()
+                && std::find(opt.algos.begin(), opt.algos.end(), name)
+                   == opt.algos.end())
+                continue;
+            auto algo = std::find_if(all.begin(), all.end(),
+                [&](const BenchSort<int>& s) { return s.name == name; });
+            for (const auto& in : inputs) {
+                BenchResult r = run_case(*algo, cmp.cmp, in.first, in.second,
+                                         opt);
+                total += r.median;
+                ok = ok && r.ok;
+            }
+        }
+        printf("  %-12s %-46s %12s\n", p.name, format_tuning(t).c_str(),
+               format_secs(total).c_str());
+        fflush(stdout);
+        return total;
+    };
+
+    printf("comparator %s, %d warmup + %d timed runs, seed %llu\n",
+           cmp.name.c_str(), opt.warmup, opt.reps,
+           (unsigned long long)opt.seed);
+    printf("  %-12s %-46s %12s\n", "moving", "setting", "cost");
+    SortTuning best = tune(sort_tuning(), cost);
+    sort_tuning() = best;
+    printf("best: %s\n", format_tuning(best).c_str());
+    if (!ok)
+        fprintf(stderr, "Some runs did not sort their input\n");
+
+    std::string path = opt.profile.empty() ? sort_tuning_path()
+                                           : opt.profile;
+    if (path != "none") {
+        if (!sort_save_tuning(path)) {
+            fprintf(stderr, "Cannot write %s\n", path.c_str());
+            return false;
+        }
+        printf("saved to %s\n", path.c_str());
+    }
+    return ok;
+}
+
+
+/***** Verification *****/
+
+/**
+ * @brief Element of the fuzzed inputs: a key to sort by and the position
+ *        it started at, which tells whether equal keys kept their order
+ */
+struct Tagged {
+    int      key;
+    uint32_t tag;
+
+    Tagged() : key(0), tag(0) {}
+    Tagged(int key, uint32_t tag = 0) : key(key), tag(tag) {}
+};
+
+/* The comparators of bench_cmps() look at the keys alone */
+bool operator<=(const Tagged& x, const Tagged& y) { return x.key <= y.key; }
+bool operator>=(const Tagged& x, const Tagged& y) { return x.key >= y.key; }
+
+template <>
+struct SortKey<Tagged> {
+    static const bool keyed = true;
+    static int64_t key(const Tagged& x) { return x.key; }
+};
+
+/** @brief Hash of a key and its tag for multiset_hash() */
+uint64_t tagged_hash(const Tagged& x) {
+    return (uint64_t)(uint32_t)x.key << 32 | x.tag;
+}
+
+/* Size of the fixed cases of --verify with repeated keys */
+const size_t VERIFY_DUP_N = 20000;
+
+/**
+ * @brief Tells what is wrong with the output of a sort
+ *
+ * @param[in] hash    multiset_hash() of the input
+ * @param[in] stable  Checks that equal keys kept the order of their tags
+ * @return Description of the first problem found, or "" if there is none
+ */
+std::string verify_output(std::vector<Tagged>& v, cmp_fn<Tagged>& cmp,
+                          size_t n, uint64_t hash, bool stable) {
+    if (v.size() != n)
+        return "size " + std::to_string(v.size()) + " instead of "
+             + std::to_string(n);
+    if (multiset_hash(v, tagged_hash) != hash)
+        return "not a permutation of the input";
+    for (size_t i = 1; i < v.size(); i++) {
+        if (!cmp(v[i - 1], v[i]))
+            return "out of order at " + std::to_string(i);
+        if (stable && cmp(v[i], v[i - 1]) && v[i - 1].tag > v[i].tag)
+            return "unstable at " + std::to_string(i);
+    }
+    return "";
+}
+
+/**
+ * @brief Runs every algorithm on random cases and checks their outputs
+ *
+ * Each case draws a distribution (with its default parameter or a small
+ * one), a size between 0 and the largest of --sizes (log-uniformly, so
+ * that the edge cases of short inputs come up often), a seed, and a
+ * comparator, all from --seed; a failure prints the options that repeat
+ * the case. The parallel sorts run under a thread limit of at least 4 (or
+ * the first of --threads), so that they interleave even on one core
+ * without running out of threads on adversarial inputs. Build with
+ * -fsanitize=thread to check them for data races at the same time.
+ *
+ * The random cases are followed by fixed ones of VERIFY_DUP_N elements (or
+ * the largest of --sizes) with every key equal and with few distinct keys,
+ * on which a partition that sends equal keys to one side recurses once per
+ * element.
+ */
+bool run_verify(const BenchOptions& opt,
+                const std::vector<BenchSort<Tagged>>& algos) {
+    std::vector<BenchCmp<Tagged>> cmps = bench_cmps<Tagged>();
+    std::vector<InputInfo> dists = input_dists();
+    size_t max_n = *std::max_element(opt.sizes.begin(), opt.sizes.end());
+    unsigned limit = opt.threads.empty()
+                   ? std::max(4u, std::thread::hardware_concurrency())
+                   : opt.threads.front();
+    printf("%d cases, n up to %zu, seed %llu, thread limit %u\n", opt.fuzz,
+           max_n, (unsigned long long)opt.seed, limit);
+    fflush(stdout);
+
+    std::mt19937_64 rng(opt.seed);
+    std::vector<int> failures(algos.size(), 0);
+    int cases = 0;
+    auto check = [&](const InputInfo& d, size_t k, size_t n, uint64_t seed,
+                     BenchCmp<Tagged>& cmp) {
+        cases++;
+        std::vector<int> keys = generate_input(d.dist, n, seed, k);
+        std::vector<Tagged> input(n);
+        for (size_t i = 0; i < n; i++)
+            input[i] = Tagged(keys[i], (uint32_t)i);
+        uint64_t hash = multiset_hash(input, tagged_hash);
+        for (size_t a = 0; a < algos.size(); a++) {
+            std::vector<Tagged> v = input;
+            SortStats stats;
+            sort_bind(&stats);
+            algos[a].sort(v, cmp.cmp);
+            sort_bind(NULL);
+            std::string bad = verify_output(v, cmp.cmp, n, hash,
+                                            algos[a].stable);
+            if (bad.empty())
+                continue;
+            failures[a]++;
+            std::string in = d.name + (k ? ":" + std::to_string(k) : "");
+            printf("FAIL %s: %s (--algos %s --inputs %s --sizes %zu "
+                   "--seed %llu --cmp %s)\n", algos[a].name.c_str(),
+                   bad.c_str(), algos[a].name.c_str(), in.c_str(), n,
+                   (unsigned long long)seed, cmp.name.c_str());
+            fflush(stdout);
+        }
+    };
+
+    sort_set_threads(limit);
+    for (int c = 0; c < opt.fuzz; c++) {
+        const InputInfo& d = dists[rng() % dists.size()];
+        size_t k    = rng() % 2 ? 0 : 1 + rng() % 16;
+        size_t n    = (size_t)std::exp(std::uniform_real_distribution<double>(
+                          0.0, std::log(max_n + 1.0))(rng)) - 1;
+        uint64_t seed = rng();
+        check(d, k, n, seed, cmps[rng() % cmps.size()]);
+    }
+    size_t dup_n = std::max(max_n, VERIFY_DUP_N);
+    for (const InputInfo& d : dists) {
+        if (d.dist == InputDist::ALL_EQUAL)
+            check(d, 0, dup_n, opt.seed, cmps.front());
+        if (d.dist == InputDist::FEW_UNIQUE)
+            for (size_t k : { 2, 16 })
+                check(d, k, dup_n, opt.seed, cmps.front());
+    }
+    sort_set_threads(0);
+
+    bool ok = true;
+    for (size_t a = 0; a < algos.size(); a++) {
+        printf("%-10s %-7s %s\n", algos[a].name.c_str(),
+               algos[a].stable ? "stable" : "",
+               failures[a] ? (std::to_string(failures[a]) + " of "
+                              + std::to_string(cases)
+                              + " cases failed").c_str() : "ok");
+        ok = ok && !failures[a];
+    }
+    return ok;
+}
+
+
+/***** Main *****/
+
+/**
+ * @brief Looks up the algorithms and comparator named in the options
+ *
+ * @return False (after printing why) if a name is unknown
+ */
+template <class T>
+bool select(const BenchOptions& opt, std::vector<BenchSort<T>>& algos,
+            BenchCmp<T>& cmp) {
+    std::vector<BenchSort<T>> all = bench_sorts<T>();
+    if (opt.algos.empty())
+        algos = all;
+    for (const std::string& name : opt.algos) {
+        auto it = std::find_if(all.begin(), all.end(),
+            [&](const BenchSort<T>& s) { return s.name == name; });
+        if (it == all.end()) {
+            fprintf(stderr, "Unknown algorithm: %s\n", name.c_str());
+            return false;
+        }
+        algos.push_back(*it);
+    }
+
+    std::vector<BenchCmp<T>> cmps = bench_cmps<T>();
+    auto it = std::find_if(cmps.begin(), cmps.end(),
+        [&](const BenchCmp<T>& c) { return c.name == opt.cmp; });
+    if (it == cmps.end()) {
+        fprintf(stderr, "Unknown comparator: %s\n", opt.cmp.c_str());
+        return false;
+    }
+    cmp = *it;
+    return true;
+}
+
+/**
+ * @brief Times the algorithms on every input and size, and writes the
+ *        reports asked for
+ *
+ * @return Exit status: 1 if some case did not sort, 2 if a report could not
+ *         be written
+ */
+template <class T>
+int run_timing(const BenchOptions& opt, std::vector<BenchSort<T>>& algos,
+               BenchCmp<T>& cmp) {
+    ReportHost host = report_host();
+    printf("git %s, %s (%s, %u cores)\n", host.git.c_str(),
+           host.host.c_str(), host.isa.c_str(), host.cores);
+    printf("comparator %s, %d warmup + %d timed runs, seed %llu\n",
+           cmp.name.c_str(), opt.warmup, opt.reps,
+           (unsigned long long)opt.seed);
+    printf("tuning %s\n", format_tuning(sort_tuning()).c_str());
+    if (opt.op_costs.any())
+        printf("costs %s (on Counted elements)\n",
+               format_costs(opt.op_costs).c_str());
+    std::vector<StreamResult> probes;
+    if (opt.stream) {
+        for (unsigned t : scaling_threads(opt)) {
+            probes.push_back(stream_probe(opt.stream_mb << 20, t));
+            printf("stream %2u threads: copy %s, triad %s\n", t,
+                   format_bandwidth(probes.back().copy).c_str(),
+                   format_bandwidth(probes.back().triad).c_str());
+        }
+    }
+    sort_costs() = opt.op_costs;
+    print_header();
+    bool ok = true;
+    std::vector<BenchResult> results;
+    for (const BenchInput& in : opt.inputs) {
+        for (size_t n : opt.sizes) {
+            std::vector<int> input = generate_input(in.dist, n, opt.seed,
+                                                    in.param);
+            Disorder disorder = measure_disorder(input);
+            print_disorder(in, n, disorder);
+            for (const BenchSort<T>& algo : algos) {
+                BenchResult r = run_case(algo, cmp.cmp, in, input, opt);
+                r.disorder = disorder;
+                if (opt.stream)
+                    r.bandwidth = stream_bandwidth(probes, r.threads);
+                print_result(r, opt);
+                results.push_back(r);
+                ok = ok && r.ok;
+            }
+        }
+    }
+    sort_costs() = SortCosts();
+    if (!opt.json.empty() && !write_json(opt.json, host, opt, results)) {
+        fprintf(stderr, "Cannot write %s\n", opt.json.c_str());
+        return 2;
+    }
+    if (!opt.csv.empty() && !write_csv(opt.csv, host, opt, results)) {
+        fprintf(stderr, "Cannot write %s\n", opt.csv.c_str());
+        return 2;
+    }
+    if (!opt.trace.empty()) {
+        std::vector<TraceRun> runs;
+        for (BenchResult& r : results)
+            runs.push_back({ r.algo + " " + r.input + " n=" +
+                             std::to_string(r.n), std::move(r.trace) });
+        if (!write_trace(opt.trace, runs)) {
+            fprintf(stderr, "Cannot write %s\n", opt.trace.c_str());
+            return 2;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    int status = parse(argc, argv, opt);
+    if (status)
+        return status < 0 ? 2 : 0;
+    if (!opt.base.empty())
+        return compare(opt);
+    std::string profile = opt.profile.empty() ? sort_tuning_path()
+                                              : opt.profile;
+    if (profile != "none" && !opt.tune)
+        sort_load_tuning(profile);
+
+    if (opt.verify) {
+        std::vector<BenchSort<Tagged>> algos;
+        BenchCmp<Tagged> cmp;
+        if (!select(opt, algos, cmp))
+            return 2;
+        return run_verify(opt, algos) ? 0 : 1;
+    }
+
+    if (opt.counts || opt.simulate) {
+        std::vector<BenchSort<Counted<int>>> algos;
+        BenchCmp<Counted<int>> cmp;
+        if (!select(opt, algos, cmp))
+            return 2;
+        if (opt.counts)
+            return run_counts(opt, algos, cmp) ? 0 : 1;
+        if (opt.algos.empty())
+            algos.erase(std::remove_if(algos.begin(), algos.end(),
+                [](const BenchSort<Counted<int>>& s) { return !s.parallel; }),
+                algos.end());
+        return run_simulation(opt, algos, cmp) ? 0 : 1;
+    }
+
+    std::vector<BenchSort<int>> algos;
+    BenchCmp<int> cmp;
+    if (!select(opt, algos, cmp))
+        return 2;
+    if (opt.tune)
+        return run_tuning(opt, cmp) ? 0 : 1;
+    if (opt.scaling || opt.interfere) {
+        if (opt.algos.empty())
+            algos.erase(std::remove_if(algos.begin(), algos.end(),
+                [](const BenchSort<int>& s) { return !s.parallel; }),
+                algos.end());
+        if (opt.interfere)
+            return run_interference(opt, algos, cmp) ? 0 : 1;
+        return run_scaling(opt, algos, cmp) ? 0 : 1;
+    }
+
+    // Only instrumented elements pay the costs (see SortCosts)
+    if (opt.op_costs.any()) {
+        std::vector<BenchSort<Counted<int>>> counted;
+        BenchCmp<Counted<int>> counted_cmp;
+        if (!select(opt, counted, counted_cmp))
+            return 2;
+        counted_cmp.cmp = counting_cmp(counted_cmp.cmp);
+        return run_timing(opt, counted, counted_cmp);
+    }
+    return run_timing(opt, algos, cmp);
+}
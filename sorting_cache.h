@@ -0,0 +1,232 @@
+/**
+ * @file  sorting_cache.h
+ * @brief Cache hierarchy simulator fed by the element accesses of a sort
+ *
+ * Defines a hierarchy of set-associative caches with LRU replacement that
+ * observes every read, write, and move a run reports (scratch buffers
+ * included) and counts the hits and misses of each level. A miss in one
+ * level goes on to the next, and every level a miss passed through is
+ * filled with the line. Unlike hardware counters, the counts are exact and
+ * do not depend on the host, so the locality of two sorts can be compared
+ * without noise. The simulated caches are shared by all threads of a run.
+ *
+ * Misses of the first level can also be counted per element of one array,
+ * to show where in the data a sort loses locality.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#ifndef __SORTING_CACHE_H__
+#define __SORTING_CACHE_H__
+
+#include "sorting_stats.h"
+#include <vector>
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+
+/** @brief Geometry of one cache level, in bytes */
+struct CacheConfig {
+    size_t size;
+    size_t assoc;
+    size_t line;
+};
+
+/** @brief A typical hierarchy: 32 KiB L1, 1 MiB L2, 8 MiB LLC */
+inline std::vector<CacheConfig> cache_default() {
+    return {
+        { 32 << 10, 8,  64 },
+        { 1 << 20,  16, 64 },
+        { 8 << 20,  16, 64 },
+    };
+}
+
+/** @brief Name of level i of a hierarchy with count levels */
+inline std::string cache_name(size_t i, size_t count) {
+    return count > 1 && i + 1 == count ? "LLC" : "L" + std::to_string(i + 1);
+}
+
+/**
+ * @brief Parses a hierarchy such as "32k:8,1m:16,8m:16"
+ *
+ * Each level is size[:assoc[:line]] with an optional k or m suffix on the
+ * size. The associativity defaults to 8 and the line size to line.
+ *
+ * @return False if the specification is malformed
+ */
+inline bool cache_parse(const std::string& spec, size_t line,
+                        std::vector<CacheConfig>& levels) {
+    levels.clear();
+    size_t i = 0;
+    while (i < spec.size()) {
+        size_t j = spec.find(',', i);
+        if (j == std::string::npos)
+            j = spec.size();
+        std::string level = spec.substr(i, j - i);
+        i = j + 1;
+
+        CacheConfig c = { 0, 8, line };
+        char* end;
+        c.size = strtoul(level.c_str(), &end, 10);
+        if (*end == 'k' || *end == 'K')
+            c.size <<= 10, end++;
+        else if (*end == 'm' || *end == 'M')
+            c.size <<= 20, end++;
+        if (*end == ':')
+            c.assoc = strtoul(end + 1, &end, 10);
+        if (*end == ':')
+            c.line = strtoul(end + 1, &end, 10);
+        if (*end || !c.size || !c.assoc || !c.line
+            || c.size < c.assoc * c.line)
+            return false;
+        levels.push_back(c);
+    }
+    return !levels.empty();
+}
+
+/** @brief One set-associative cache with LRU replacement */
+class CacheLevel {
+public:
+    CacheConfig config;
+
+    uint64_t accesses;
+    uint64_t misses;
+
+    CacheLevel(const CacheConfig& c)
+      : config(c), sets(std::max<size_t>(1, c.size / (c.assoc * c.line))) {
+        clear();
+    }
+
+    /** @brief Empties the cache and zeroes the counts */
+    void clear() {
+        tags.assign(sets * config.assoc, 0);
+        stamps.assign(sets * config.assoc, 0);
+        clock    = 0;
+        accesses = 0;
+        misses   = 0;
+    }
+
+    /** @brief Looks up the line holding addr, filling it on a miss */
+    bool access(uint64_t addr) {
+        uint64_t tag = addr / config.line + 1;  // 0 marks an empty way
+        size_t   set = (size_t)(tag % sets) * config.assoc;
+        size_t   lru = set;
+        accesses++;
+        clock++;
+        for (size_t w = set; w < set + config.assoc; w++) {
+            if (tags[w] == tag) {
+                stamps[w] = clock;
+                return true;
+            }
+            if (stamps[w] < stamps[lru])
+                lru = w;
+        }
+        misses++;
+        tags[lru]   = tag;
+        stamps[lru] = clock;
+        return false;
+    }
+
+private:
+    size_t sets;
+
+    /** @brief Line held by each way (set-major) and when it was last used */
+    std::vector<uint64_t> tags, stamps;
+
+    uint64_t clock;
+};
+
+/** @brief Observer running the accesses of a run through a cache hierarchy */
+class CacheSim : public SortWatch {
+public:
+    CacheSim(const std::vector<CacheConfig>& configs = cache_default())
+      : base(NULL), n(0), size(1) {
+        configure(configs);
+    }
+
+    /** @brief Replaces the hierarchy with empty caches of the given sizes */
+    void configure(const std::vector<CacheConfig>& configs) {
+        std::lock_guard<std::mutex> lock(m);
+        levels.clear();
+        for (const CacheConfig& c : configs)
+            levels.push_back(CacheLevel(c));
+    }
+
+    /** @brief Empties every level and zeroes the counts */
+    void reset() {
+        std::lock_guard<std::mutex> lock(m);
+        for (CacheLevel& l : levels)
+            l.clear();
+        std::fill(heat.begin(), heat.end(), 0);
+    }
+
+    /** @brief Counts the first level misses of each element of an array */
+    void track(const void* data, size_t count, size_t elem_size) {
+        std::lock_guard<std::mutex> lock(m);
+        base = (const char*)data;
+        n    = count;
+        size = std::max<size_t>(elem_size, 1);
+        heat.assign(n, 0);
+    }
+
+    void on_access(SortAccess /* kind */, const void* p) override {
+        uint64_t addr = (uint64_t)(uintptr_t)p;
+        std::lock_guard<std::mutex> lock(m);
+        for (size_t i = 0; i < levels.size(); i++) {
+            if (levels[i].access(addr))
+                break;
+            const char* c = (const char*)p;
+            if (!i && base <= c && c < base + n * size)
+                heat[(c - base) / size]++;
+        }
+    }
+
+    /** @brief Number of levels */
+    size_t depth() const {
+        return levels.size();
+    }
+
+    /** @brief Accesses and misses of level i so far */
+    void counts(size_t i, uint64_t& accesses, uint64_t& misses) {
+        std::lock_guard<std::mutex> lock(m);
+        accesses = levels[i].accesses;
+        misses   = levels[i].misses;
+    }
+
+    /** @brief First level misses of each element of the tracked array */
+    std::vector<uint64_t> heatmap() {
+        std::lock_guard<std::mutex> lock(m);
+        return heat;
+    }
+
+private:
+    std::mutex m;
+    std::vector<CacheLevel> levels;
+
+    /** @brief Tracked array, its length, and the size of its elements */
+    const char* base;
+    size_t      n, size;
+
+    std::vector<uint64_t> heat;
+};
+
+/** @brief Formats the misses of every level, e.g. "L1 1.2k (3.4%)" */
+inline std::string format_cache(CacheSim& cache, const char* sep = "  ") {
+    std::string s;
+    for (size_t i = 0; i < cache.depth(); i++) {
+        uint64_t accesses, misses;
+        cache.counts(i, accesses, misses);
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s%s miss %s (%.1f%%)", i ? sep : "",
+                 cache_name(i, cache.depth()).c_str(),
+                 format_count(misses).c_str(),
+                 accesses ? 100.0 * misses / accesses : 0.0);
+        s += buf;
+    }
+    return s;
+}
+
+#endif
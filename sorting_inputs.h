@@ -0,0 +1,277 @@
+/**
+ * @file  sorting_inputs.h
+ * @brief Generators of inputs for the sorting algorithms
+ *
+ * Defines several input distributions, including
+ *      - Uniform random permutation
+ *      - Sorted and reversed
+ *      - Nearly sorted (sorted with k random swaps)
+ *      - Sawtooth and organ pipe
+ *      - Few unique values, Zipf, and Gaussian distributed values
+ *      - All equal
+ *      - Quicksort killer (adversarial input for quick_sort of sorting.h)
+ * Every generator returns n values within [1, n] (so they can be drawn as
+ * bars) and is reproducible from its seed. Random values are derived from a
+ * hash of the seed and the position, which lets large inputs be filled by
+ * several threads while staying identical to a sequential fill. Only the
+ * fills are parallel: the Fisher-Yates shuffle of the random permutation
+ * and the swaps of the nearly sorted input run on one thread, and the
+ * shuffle dominates the time to generate a large random input.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#ifndef __SORTING_INPUTS_H__
+#define __SORTING_INPUTS_H__
+
+#include "sorting.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+
+/**
+ * @brief Enum type for input distributions
+ *
+ * Types of distributions (the parameter k is optional):
+ *      RANDOM:     Uniform random permutation of 1..n
+ *      SORTED:     1, 2, ..., n
+ *      REVERSED:   n, n - 1, ..., 1
+ *      NEARLY:     Sorted, then k random swaps (default n / 100)
+ *      SAWTOOTH:   k ascending teeth (default 4)
+ *      ORGAN_PIPE: Ascending to the middle, then descending
+ *      FEW_UNIQUE: k distinct values spread over 1..n (default 8)
+ *      ZIPF:       Ranks drawn with probability proportional to 1 / rank
+ *      GAUSSIAN:   Normal with mean n / 2 and deviation n / 6, clamped
+ *      ALL_EQUAL:  Every value is n / 2
+ *      KILLER:     Makes quick_sort and pquick_sort quadratic. Built by
+ *                  running quick_sort against McIlroy's adversary, so it
+ *                  takes quadratic time itself; keep n modest
+ */
+enum class InputDist {
+    RANDOM, SORTED, REVERSED, NEARLY, SAWTOOTH, ORGAN_PIPE, FEW_UNIQUE, ZIPF,
+    GAUSSIAN, ALL_EQUAL, KILLER
+};
+
+/** @brief Name and description of an input distribution */
+struct InputInfo {
+    InputDist   dist;
+    std::string name;
+    std::string desc;
+};
+
+/** @brief Returns every input distribution, in the order of InputDist */
+inline const std::vector<InputInfo>& input_dists() {
+    static const std::vector<InputInfo> dists = {
+        { InputDist::RANDOM,     "random",   "uniform random permutation" },
+        { InputDist::SORTED,     "sorted",   "already sorted" },
+        { InputDist::REVERSED,   "reversed", "sorted in reverse" },
+        { InputDist::NEARLY,     "nearly",   "sorted with k swaps" },
+        { InputDist::SAWTOOTH,   "sawtooth", "k ascending teeth" },
+        { InputDist::ORGAN_PIPE, "organ",    "ascending then descending" },
+        { InputDist::FEW_UNIQUE, "few",      "k distinct values" },
+        { InputDist::ZIPF,       "zipf",     "Zipf distributed ranks" },
+        { InputDist::GAUSSIAN,   "gaussian", "normally distributed values" },
+        { InputDist::ALL_EQUAL,  "equal",    "every value equal" },
+        { InputDist::KILLER,     "killer",   "adversarial for quick_sort" },
+    };
+    return dists;
+}
+
+/** @brief Returns the name of an input distribution */
+inline const std::string& input_name(InputDist d) {
+    return input_dists()[(int)d].name;
+}
+
+/**
+ * @brief Looks up an input distribution by name
+ *
+ * @return False if there is no such distribution
+ */
+inline bool input_from_name(const std::string& name, InputDist& d) {
+    for (const InputInfo& info : input_dists()) {
+        if (info.name == name) {
+            d = info.dist;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/***** Randomness *****/
+
+/** @brief SplitMix64 hash, used as a counter based random generator */
+inline uint64_t input_hash(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/** @brief Random 64-bit value for position i of stream s */
+inline uint64_t input_random(uint64_t seed, uint64_t s, uint64_t i) {
+    return input_hash(input_hash(seed ^ input_hash(s)) + i);
+}
+
+/** @brief Random value in [0, 1) for position i of stream s */
+inline double input_uniform(uint64_t seed, uint64_t s, uint64_t i) {
+    return (input_random(seed, s, i) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/** @brief Random value in [0, bound) for position i of stream s */
+inline size_t input_below(uint64_t seed, uint64_t s, uint64_t i,
+                          size_t bound) {
+    return (size_t)(input_uniform(seed, s, i) * bound);
+}
+
+
+/***** Generators *****/
+
+/** @brief Inputs at least this long are filled by several threads */
+const size_t INPUT_PARALLEL_MIN = 1 << 16;
+
+/** @brief Sets v[i] = f(i) for every i, in parallel for long inputs */
+template <class F>
+void input_fill(std::vector<int>& v, F f) {
+    size_t n = v.size();
+    size_t t = n >= INPUT_PARALLEL_MIN ? std::thread::hardware_concurrency()
+                                       : 1;
+    t = std::max<size_t>(t, 1);
+    std::vector<std::thread> threads;
+    for (size_t k = 0; k < t; k++) {
+        size_t lo = n * k / t, hi = n * (k + 1) / t;
+        auto fill = [&v, &f, lo, hi]() {
+            for (size_t i = lo; i < hi; i++)
+                v[i] = f(i);
+        };
+        if (k + 1 == t)
+            fill();
+        else
+            threads.push_back(std::thread(fill));
+    }
+    for (std::thread& th : threads)
+        th.join();
+}
+
+/** @brief Clamps x into [1, n] */
+inline int input_clamp(double x, size_t n) {
+    return (int)std::min<double>(std::max<double>(std::round(x), 1.0), n);
+}
+
+/**
+ * @brief Builds an input on which quick_sort takes quadratic time
+ *
+ * Runs quick_sort on positions with a comparator that fixes values only
+ * when it has to (McIlroy, "A Killer Adversary for Quicksort"), making
+ * every pivot as small as possible.
+ */
+inline std::vector<int> input_killer(size_t n) {
+    std::vector<int> val(n, (int)n), pos(n);
+    int solid = 0, candidate = -1;
+    int gas = (int)n;
+    for (size_t i = 0; i < n; i++)
+        pos[i] = i;
+    cmp_fn<int> adversary = [&](int& x, int& y) {
+        if (val[x] == gas && val[y] == gas)
+            val[x == candidate ? x : y] = solid++;
+        if (val[x] == gas)
+            candidate = x;
+        else if (val[y] == gas)
+            candidate = y;
+        return val[x] <= val[y];
+    };
+    quick_sort<int>(pos, adversary);
+    std::vector<int> v(n);
+    for (size_t i = 0; i < n; i++)
+        v[i] = (val[i] == gas ? solid++ : val[i]) + 1;
+    return v;
+}
+
+/**
+ * @brief Generates an input
+ *
+ * @param[in] d     Distribution
+ * @param[in] n     Number of values
+ * @param[in] seed  Seed; equal arguments always give equal inputs
+ * @param[in] k     Parameter of the distribution (0 for its default)
+ */
+inline std::vector<int> generate_input(InputDist d, size_t n, uint64_t seed,
+                                       size_t k = 0) {
+    std::vector<int> v(n);
+    if (!n)
+        return v;
+    switch (d) {
+    case InputDist::RANDOM:
+        input_fill(v, [](size_t i) { return (int)i + 1; });
+        for (size_t i = n - 1; i > 0; i--)
+            std::swap(v[i], v[input_below(seed, 0, i, i + 1)]);
+        break;
+    case InputDist::SORTED:
+        input_fill(v, [](size_t i) { return (int)i + 1; });
+        break;
+    case InputDist::REVERSED:
+        input_fill(v, [n](size_t i) { return (int)(n - i); });
+        break;
+    case InputDist::NEARLY:
+        k = k ? k : std::max<size_t>(1, n / 100);
+        input_fill(v, [](size_t i) { return (int)i + 1; });
+        for (size_t j = 0; j < k; j++)
+            std::swap(v[input_below(seed, 1, j, n)],
+                      v[input_below(seed, 2, j, n)]);
+        break;
+    case InputDist::SAWTOOTH: {
+        k = std::min(k ? k : 4, n);
+        size_t len = (n + k - 1) / k;
+        input_fill(v, [n, len](size_t i) {
+            return (int)(1 + (i % len) * n / len);
+        });
+        break;
+    }
+    case InputDist::ORGAN_PIPE:
+        input_fill(v, [n](size_t i) {
+            return (int)std::min(2 * i + 1, 2 * (n - 1 - i) + 2);
+        });
+        break;
+    case InputDist::FEW_UNIQUE:
+        k = std::min(k ? k : 8, n);
+        input_fill(v, [seed, n, k](size_t i) {
+            size_t j = input_below(seed, 3, i, k);
+            return (int)(1 + (k > 1 ? j * (n - 1) / (k - 1) : 0));
+        });
+        break;
+    case InputDist::ZIPF: {
+        std::vector<double> cdf(n);
+        double sum = 0.0;
+        for (size_t r = 0; r < n; r++)
+            cdf[r] = (sum += 1.0 / (r + 1));
+        input_fill(v, [&cdf, seed, sum](size_t i) {
+            double u = input_uniform(seed, 4, i) * sum;
+            return (int)(std::upper_bound(cdf.begin(), cdf.end() - 1, u)
+                       - cdf.begin()) + 1;
+        });
+        break;
+    }
+    case InputDist::GAUSSIAN:
+        input_fill(v, [seed, n](size_t i) {
+            double u1 = 1.0 - input_uniform(seed, 5, i);
+            double u2 = input_uniform(seed, 6, i);
+            double z  = std::sqrt(-2.0 * std::log(u1))
+                      * std::cos(6.283185307179586 * u2);
+            return input_clamp(0.5 * n + z * n / 6.0, n);
+        });
+        break;
+    case InputDist::ALL_EQUAL:
+        input_fill(v, [n](size_t) { return (int)std::max<size_t>(n / 2, 1); });
+        break;
+    case InputDist::KILLER:
+        v = input_killer(n);
+        break;
+    }
+    return v;
+}
+
+#endif
@@ -0,0 +1,244 @@
+/**
+ * @file  sorting_perf.h
+ * @brief Hardware performance counters around sort runs
+ *
+ * Defines a thin wrapper over Linux perf_event_open that counts cycles,
+ * instructions, L1D read misses, last level cache misses, branch misses, and
+ * dTLB read misses for the calling thread. Counters are opened with the
+ * inherit flag, so threads created afterwards (such as the threads of the
+ * parallel sorts) are included once they have been joined. Elsewhere, or when
+ * the kernel refuses (see /proc/sys/kernel/perf_event_paranoid), every
+ * counter is reported as unavailable.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#ifndef __SORTING_PERF_H__
+#define __SORTING_PERF_H__
+
+#include "sorting_stats.h"
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+/** @brief Number of hardware events counted */
+const int PERF_EVENTS = 6;
+
+/**
+ * @brief Enum type for the hardware events
+ *
+ * Types of events:
+ *      CYCLES:        CPU cycles
+ *      INSTRUCTIONS:  Instructions retired
+ *      L1D_MISSES:    L1 data cache read misses
+ *      LLC_MISSES:    Last level cache misses
+ *      BRANCH_MISSES: Mispredicted branches
+ *      DTLB_MISSES:   Data TLB read misses
+ */
+enum class PerfEvent {
+    CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, DTLB_MISSES
+};
+
+/** @brief Short name of a hardware event */
+inline const char* perf_name(PerfEvent e) {
+    const char* names[PERF_EVENTS] = {
+        "cycles", "instr", "l1d_miss", "llc_miss", "br_miss", "dtlb_miss"
+    };
+    return names[(int)e];
+}
+
+/** @brief Values read from the hardware counters */
+struct PerfCounts {
+    /** @brief False for events the kernel or hardware did not count */
+    bool valid[PERF_EVENTS];
+
+    uint64_t value[PERF_EVENTS];
+
+    PerfCounts() {
+        for (int i = 0; i < PERF_EVENTS; i++) {
+            valid[i] = false;
+            value[i] = 0;
+        }
+    }
+
+    /** @brief True if at least one event was counted */
+    bool any() const {
+        for (int i = 0; i < PERF_EVENTS; i++)
+            if (valid[i])
+                return true;
+        return false;
+    }
+
+    /** @brief Value of an event */
+    uint64_t operator[](PerfEvent e) const {
+        return value[(int)e];
+    }
+
+    /** @brief Instructions per cycle (0 if unknown) */
+    double ipc() const {
+        int c = (int)PerfEvent::CYCLES, i = (int)PerfEvent::INSTRUCTIONS;
+        if (!valid[c] || !valid[i] || !value[c])
+            return 0.0;
+        return (double)value[i] / value[c];
+    }
+
+    /** @brief Adds the values of another reading */
+    PerfCounts& operator+=(const PerfCounts& p) {
+        for (int i = 0; i < PERF_EVENTS; i++) {
+            valid[i] = valid[i] || p.valid[i];
+            value[i] += p.value[i];
+        }
+        return *this;
+    }
+};
+
+/**
+ * @brief Hardware counters of the calling thread and its future threads
+ *
+ * Create the object on the thread that runs the sort, call start() right
+ * before the sort and stop() after every thread of the sort has been joined.
+ */
+class PerfCounters {
+public:
+    /**
+     * @param[in] enabled  False to open no counter at all, so that the
+     *                     threads of the sort do not inherit them; start()
+     *                     and stop() then do nothing
+     */
+    explicit PerfCounters(bool enabled = true) {
+        for (int i = 0; i < PERF_EVENTS; i++)
+            fd[i] = enabled ? open((PerfEvent)i) : -1;
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int i = 0; i < PERF_EVENTS; i++)
+            if (fd[i] >= 0)
+                close(fd[i]);
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    /** @brief True if at least one counter could be opened */
+    bool available() const {
+        for (int i = 0; i < PERF_EVENTS; i++)
+            if (fd[i] >= 0)
+                return true;
+        return false;
+    }
+
+    /** @brief Zeroes and enables the counters */
+    void start() {
+#ifdef __linux__
+        for (int i = 0; i < PERF_EVENTS; i++) {
+            if (fd[i] < 0)
+                continue;
+            ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /** @brief Disables the counters and reads them */
+    PerfCounts stop() {
+        PerfCounts p;
+#ifdef __linux__
+        for (int i = 0; i < PERF_EVENTS; i++) {
+            if (fd[i] < 0)
+                continue;
+            ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t buf[3];
+            if (read(fd[i], buf, sizeof(buf)) != sizeof(buf) || !buf[2])
+                continue;
+            // Scale up if the kernel had to multiplex the counters
+            p.valid[i] = true;
+            p.value[i] = buf[1] == buf[2]
+                       ? buf[0]
+                       : (uint64_t)((double)buf[0] * buf[1] / buf[2]);
+        }
+#endif
+        return p;
+    }
+
+private:
+    int fd[PERF_EVENTS];
+
+    /** @brief Opens the (disabled) counter of an event, -1 on failure */
+    static int open(PerfEvent e) {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled       = 1;
+        attr.inherit        = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED
+                            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        uint64_t read_miss = PERF_COUNT_HW_CACHE_OP_READ << 8
+                           | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        switch (e) {
+        case PerfEvent::CYCLES:
+            attr.type   = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfEvent::INSTRUCTIONS:
+            attr.type   = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfEvent::L1D_MISSES:
+            attr.type   = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | read_miss;
+            break;
+        case PerfEvent::LLC_MISSES:
+            attr.type   = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PerfEvent::BRANCH_MISSES:
+            attr.type   = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PerfEvent::DTLB_MISSES:
+            attr.type   = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | read_miss;
+            break;
+        }
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        return -1;
+#endif
+    }
+};
+
+/** @brief Formats the counters on one line, e.g. "cycles 1.2M  ipc 1.4" */
+inline std::string format_perf(const PerfCounts& p, const char* sep = "  ") {
+    std::string s;
+    if (!p.any())
+        return "perf n/a";
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (!p.valid[i])
+            continue;
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%s%s %s", s.empty() ? "" : sep,
+                 perf_name((PerfEvent)i), format_count(p.value[i]).c_str());
+        s += buf;
+        if ((PerfEvent)i == PerfEvent::INSTRUCTIONS && p.ipc() > 0.0) {
+            snprintf(buf, sizeof(buf), "%sipc %.2f", sep, p.ipc());
+            s += buf;
+        }
+    }
+    return s;
+}
+
+#endif
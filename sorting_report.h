@@ -0,0 +1,481 @@
+/**
+ * @file  sorting_report.h
+ * @brief Machine readable benchmark reports and their comparison
+ *
+ * Defines
+ *      - A description of the build and host (git revision, compiler, ISA
+ *        extensions enabled at compile time, CPU, and core count) recorded
+ *        with every report, so that two reports can be told apart later
+ *      - A small JSON writer and reader, enough for the reports written by
+ *        sorting_bench.cpp
+ *      - The Mann-Whitney U test, used to decide whether two sets of timings
+ *        differ by more than noise
+ *      - A writer for the sections traced during runs (see SortTrace) in the
+ *        Chrome trace event format, which chrome://tracing and
+ *        ui.perfetto.dev open as a timeline per thread
+ *
+ * The git revision is taken from the SORT_GIT_HASH macro when it is defined
+ * (e.g. -DSORT_GIT_HASH="\"$(git rev-parse --short HEAD)\""), and otherwise
+ * asked from git at run time.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#ifndef __SORTING_REPORT_H__
+#define __SORTING_REPORT_H__
+
+#include "sorting_stats.h"
+#include <string>
+#include <vector>
+#include <utility>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+
+/***** Build and host *****/
+
+/** @brief Where and from what a report was produced */
+struct ReportHost {
+    std::string git;
+    std::string date;
+    std::string host;
+    std::string cpu;
+    unsigned    cores;
+    std::string compiler;
+
+    /** @brief Instruction set extensions the build was allowed to use */
+    std::string isa;
+};
+
+/** @brief Output of a shell command with trailing whitespace removed */
+inline std::string report_shell(const char* cmd) {
+    std::string out;
+#if defined(__unix__) || defined(__APPLE__)
+    FILE* f = popen(cmd, "r");
+    if (!f)
+        return out;
+    char buf[256];
+    while (fgets(buf, sizeof(buf), f))
+        out += buf;
+    pclose(f);
+#endif
+    while (!out.empty() && isspace((unsigned char)out.back()))
+        out.pop_back();
+    return out;
+}
+
+/** @brief ISA extensions enabled by the compiler flags, e.g. "sse4.2 avx2" */
+inline std::string report_isa() {
+    std::string isa;
+    auto add = [&isa](const char* name) {
+        isa += isa.empty() ? name : std::string(" ") + name;
+    };
+#if defined(__x86_64__) || defined(_M_X64)
+    add("x86-64");
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    add("aarch64");
+#endif
+#ifdef __SSE4_2__
+    add("sse4.2");
+#endif
+#ifdef __AVX__
+    add("avx");
+#endif
+#ifdef __AVX2__
+    add("avx2");
+#endif
+#ifdef __AVX512F__
+    add("avx512f");
+#endif
+#ifdef __BMI2__
+    add("bmi2");
+#endif
+#ifdef __ARM_NEON
+    add("neon");
+#endif
+#ifdef __ARM_FEATURE_SVE
+    add("sve");
+#endif
+    return isa.empty() ? "unknown" : isa;
+}
+
+/** @brief Name of the host ("unknown" if it cannot be told) */
+inline std::string report_hostname() {
+#if defined(__unix__) || defined(__APPLE__)
+    char buf[256];
+    if (!gethostname(buf, sizeof(buf))) {
+        buf[sizeof(buf) - 1] = '\0';
+        return buf;
+    }
+#endif
+    return "unknown";
+}
+
+/** @brief Describes the running build and host */
+inline ReportHost report_host() {
+    ReportHost h;
+#ifdef SORT_GIT_HASH
+    h.git = SORT_GIT_HASH;
+#else
+    h.git = report_shell("git rev-parse --short HEAD 2>/dev/null");
+#endif
+    if (h.git.empty())
+        h.git = "unknown";
+
+    char buf[256];
+    time_t now = time(NULL);
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    h.date = buf;
+
+    h.host = report_hostname();
+
+    h.cpu = "unknown";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        size_t colon = line.find(':');
+        if (line.compare(0, 10, "model name") == 0
+            && colon != std::string::npos) {
+            h.cpu = line.substr(line.find_first_not_of(" \t", colon + 1));
+            break;
+        }
+    }
+
+    h.cores = std::thread::hardware_concurrency();
+#if defined(__clang__)
+    h.compiler = std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+    h.compiler = std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+    h.compiler = "msvc " + std::to_string(_MSC_VER);
+#else
+    h.compiler = "unknown";
+#endif
+    h.isa = report_isa();
+    return h;
+}
+
+
+/***** JSON *****/
+
+/** @brief Quotes and escapes a string for JSON */
+inline std::string json_quote(const std::string& s) {
+    std::string q = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            q += '\\';
+            q += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            q += buf;
+        } else {
+            q += c;
+        }
+    }
+    return q + "\"";
+}
+
+/** @brief Formats a number for JSON (null if not finite) */
+inline std::string json_number(double x) {
+    if (!std::isfinite(x))
+        return "null";
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", x);
+    return buf;
+}
+
+/** @brief The build and host as a JSON object */
+inline std::string json_host(const ReportHost& h) {
+    return "{\"git\": " + json_quote(h.git)
+         + ", \"date\": " + json_quote(h.date)
+         + ", \"host\": " + json_quote(h.host)
+         + ", \"cpu\": " + json_quote(h.cpu)
+         + ", \"cores\": " + std::to_string(h.cores)
+         + ", \"compiler\": " + json_quote(h.compiler)
+         + ", \"isa\": " + json_quote(h.isa) + "}";
+}
+
+/** @brief Enum type for the kinds of JSON values */
+enum class JsonType { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+/** @brief Parsed JSON value */
+struct JsonValue {
+    JsonType    type;
+    bool        boolean;
+    double      number;
+    std::string str;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> fields;
+
+    JsonValue() : type(JsonType::NUL), boolean(false), number(0.0) {}
+
+    /** @brief Field of an object, or null if there is no such field */
+    const JsonValue& operator[](const std::string& key) const {
+        static const JsonValue null;
+        for (const auto& f : fields)
+            if (f.first == key)
+                return f.second;
+        return null;
+    }
+
+    /** @brief Number, or def if this is not a number */
+    double num(double def = 0.0) const {
+        return type == JsonType::NUMBER ? number : def;
+    }
+
+    /** @brief String, or def if this is not a string */
+    std::string text(const std::string& def = "") const {
+        return type == JsonType::STRING ? str : def;
+    }
+};
+
+/** @brief Recursive descent JSON reader */
+class JsonReader {
+public:
+    JsonReader(const std::string& text) : s(text), i(0) {}
+
+    /** @brief Reads the whole text as one value, false if malformed */
+    bool read(JsonValue& v) {
+        return value(v) && (skip(), i == s.size());
+    }
+
+private:
+    const std::string& s;
+    size_t i;
+
+    void skip() {
+        while (i < s.size() && isspace((unsigned char)s[i]))
+            i++;
+    }
+
+    bool eat(char c) {
+        skip();
+        if (i < s.size() && s[i] == c) {
+            i++;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(const char* word) {
+        size_t n = strlen(word);
+        if (s.compare(i, n, word) != 0)
+            return false;
+        i += n;
+        return true;
+    }
+
+    bool string(std::string& out) {
+        if (!eat('"'))
+            return false;
+        for (; i < s.size() && s[i] != '"'; i++) {
+            if (s[i] != '\\') {
+                out += s[i];
+                continue;
+            }
+            if (++i >= s.size())
+                return false;
+            switch (s[i]) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u':
+                // Only the control characters json_quote() writes
+                if (i + 4 >= s.size())
+                    return false;
+                out += (char)strtol(s.substr(i + 1, 4).c_str(), NULL, 16);
+                i += 4;
+                break;
+            default:  out += s[i]; break;
+            }
+        }
+        return i++ < s.size();
+    }
+
+    bool value(JsonValue& v) {
+        skip();
+        if (i >= s.size())
+            return false;
+        char c = s[i];
+        if (c == '{') {
+            v.type = JsonType::OBJECT;
+            i++;
+            if (eat('}'))
+                return true;
+            do {
+                std::pair<std::string, JsonValue> f;
+                if (!string(f.first) || !eat(':') || !value(f.second))
+                    return false;
+                v.fields.push_back(f);
+            } while (eat(','));
+            return eat('}');
+        } else if (c == '[') {
+            v.type = JsonType::ARRAY;
+            i++;
+            if (eat(']'))
+                return true;
+            do {
+                v.items.push_back(JsonValue());
+                if (!value(v.items.back()))
+                    return false;
+            } while (eat(','));
+            return eat(']');
+        } else if (c == '"') {
+            v.type = JsonType::STRING;
+            return string(v.str);
+        } else if (literal("true")) {
+            v.type    = JsonType::BOOL;
+            v.boolean = true;
+            return true;
+        } else if (literal("false")) {
+            v.type = JsonType::BOOL;
+            return true;
+        } else if (literal("null")) {
+            v.type = JsonType::NUL;
+            return true;
+        }
+        const char* start = s.c_str() + i;
+        char* end;
+        v.number = strtod(start, &end);
+        if (end == start)
+            return false;
+        v.type = JsonType::NUMBER;
+        i += end - start;
+        return true;
+    }
+};
+
+/** @brief Reads and parses a JSON file, false if unreadable or malformed */
+inline bool read_json(const std::string& path, JsonValue& v) {
+    std::ifstream f(path);
+    if (!f)
+        return false;
+    std::stringstream text;
+    text << f.rdbuf();
+    std::string s = text.str();
+    return JsonReader(s).read(v);
+}
+
+
+/***** Statistics *****/
+
+/**
+ * @brief Two-sided Mann-Whitney U test
+ *
+ * Tests whether values drawn like a tend to be larger or smaller than values
+ * drawn like b, without assuming normal timings. Uses the normal
+ * approximation with a correction for ties, which is adequate from about
+ * five samples per side.
+ *
+ * @return p-value, 1 if either side is empty
+ */
+inline double mann_whitney_p(const std::vector<double>& a,
+                             const std::vector<double>& b) {
+    size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+    if (!n1 || !n2)
+        return 1.0;
+    std::vector<std::pair<double, int>> all;
+    for (double x : a)
+        all.push_back({ x, 0 });
+    for (double x : b)
+        all.push_back({ x, 1 });
+    std::sort(all.begin(), all.end());
+
+    // Rank sum of a, giving tied values their average rank
+    double r1 = 0.0, ties = 0.0;
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j < n && all[j].first == all[i].first)
+            j++;
+        double rank = (i + j + 1) / 2.0, t = (double)(j - i);
+        for (size_t k = i; k < j; k++)
+            if (all[k].second == 0)
+                r1 += rank;
+        ties += t * t * t - t;
+        i = j;
+    }
+    double u    = r1 - n1 * (n1 + 1) / 2.0;
+    double mean = n1 * n2 / 2.0;
+    double var  = n1 * n2 / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+    if (var <= 0.0)
+        return 1.0;
+    double z = (std::fabs(u - mean) - 0.5) / std::sqrt(var);
+    return std::min(1.0, std::erfc(std::max(z, 0.0) / std::sqrt(2.0)));
+}
+
+
+/***** Traces *****/
+
+/** @brief Sections traced during one run, under the name to show it by */
+struct TraceRun {
+    std::string name;
+    std::vector<SortTraceEvent> events;
+};
+
+/**
+ * @brief Writes traced runs as a Chrome trace
+ *
+ * Each run becomes a process and each thread of the run (see
+ * SortTraceEvent::thread) a thread, whose sections are complete events
+ * carrying the number of elements they covered. Times count from the
+ * earliest section of any run.
+ *
+ * @return False if the file could not be written
+ */
+inline bool write_trace(const std::string& path,
+                        const std::vector<TraceRun>& runs) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    int64_t origin = INT64_MAX;
+    for (const TraceRun& r : runs)
+        for (const SortTraceEvent& e : r.events)
+            origin = std::min(origin, e.start);
+
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    const char* sep = "\n";
+    for (size_t pid = 0; pid < runs.size(); pid++) {
+        const TraceRun& r = runs[pid];
+        fprintf(f, "%s{\"name\": \"process_name\", \"ph\": \"M\", "
+                "\"pid\": %zu, \"args\": {\"name\": %s}}", sep, pid,
+                json_quote(r.name).c_str());
+        sep = ",\n";
+        std::vector<bool> named;
+        for (const SortTraceEvent& e : r.events) {
+            if ((size_t)e.thread >= named.size())
+                named.resize(e.thread + 1);
+            if (!named[e.thread]) {
+                named[e.thread] = true;
+                fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", "
+                        "\"pid\": %zu, \"tid\": %d, \"args\": "
+                        "{\"name\": \"%s %d\"}}", sep, pid, e.thread,
+                        e.thread < SORT_MAX_WORKERS ? "worker" : "thread",
+                        e.thread);
+            }
+            fprintf(f, "%s{\"name\": %s, \"ph\": \"X\", \"pid\": %zu, "
+                    "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, "
+                    "\"args\": {\"n\": %zu}}", sep,
+                    json_quote(e.name).c_str(), pid, e.thread,
+                    (e.start - origin) * 1e-3, e.dur * 1e-3, e.n);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+#endif
@@ -0,0 +1,473 @@
+/**
+ * @file  sorting_sim.h
+ * @brief Simulated execution of the parallel sorts on many processors
+ *
+ * A run of a parallel sort is recorded as the task DAG that sort_fork()
+ * builds: every task is a chain of segments separated by forks, each fork
+ * starting two tasks and waiting for both. Segments are weighed by the
+ * element accesses made in them, so the DAG does not depend on the machine
+ * it was recorded on. The DAG can then be replayed on any number of virtual
+ * processors under
+ *      - Greedy scheduling: one central FIFO queue of ready tasks, taken by
+ *        whichever processor is idle
+ *      - Work stealing: every processor keeps a deque, runs the head task of
+ *        a fork itself and leaves the tail for thieves, which take the
+ *        oldest task of a randomly chosen victim
+ * with a cost model that charges time per read and per write or move,
+ * a fixed cost per fork and per steal attempt, and a memory bandwidth
+ * shared by the processors. Everything is deterministic, so small hosts can
+ * predict the speedup curves of large ones.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#ifndef __SORTING_SIM_H__
+#define __SORTING_SIM_H__
+
+#include "sorting_stats.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+
+/***** Recording *****/
+
+/** @brief Element accesses of a segment of a task */
+struct SimCost {
+    /** @brief Reads (loads to compare or copy) */
+    uint64_t compute;
+
+    /** @brief Writes and moves (stores) */
+    uint64_t memory;
+};
+
+/** @brief Task of a recorded DAG */
+struct SimTask {
+    /** @brief Segments, one more than forks */
+    std::vector<SimCost> segs;
+
+    /** @brief Head and tail task started after each segment but the last */
+    std::vector<std::pair<int, int>> forks;
+
+    /** @brief Task that forked this one (-1 for the root) */
+    int parent;
+};
+
+/**
+ * @brief Observer recording the task DAG of a run
+ *
+ * The events of sort_fork() must arrive in their nested order, so record
+ * with a thread limit of 1 (see sort_set_threads()); the DAG is the same
+ * however the tasks would have been scheduled. Accesses are only weighed if
+ * they are reported, so sort Counted elements with counting_cmp().
+ */
+class SimRecorder : public SortWatch {
+public:
+    /** @brief Recorded tasks; the root, task 0, is the whole run */
+    std::vector<SimTask> tasks;
+
+    SimRecorder() { reset(); }
+
+    /** @brief Forgets the recorded DAG */
+    void reset() {
+        tasks.assign(1, SimTask{ { SimCost{ 0, 0 } }, {}, -1 });
+        stack.assign(1, 0);
+    }
+
+    void on_access(SortAccess kind, const void* /* p */) override {
+        SimCost& c = tasks[stack.back()].segs.back();
+        if (kind == SortAccess::READ)
+            c.compute++;
+        else
+            c.memory++;
+    }
+
+    void on_fork(SortFork event) override {
+        int cur = stack.back();
+        switch (event) {
+        case SortFork::FORK:
+            tasks[cur].forks.push_back({ -1, -1 });
+            break;
+        case SortFork::BEGIN: {
+            int id = (int)tasks.size();
+            tasks.push_back(SimTask{ { SimCost{ 0, 0 } }, {}, cur });
+            std::pair<int, int>& f = tasks[cur].forks.back();
+            (f.first < 0 ? f.first : f.second) = id;
+            stack.push_back(id);
+            break;
+        }
+        case SortFork::END:
+            stack.pop_back();
+            break;
+        case SortFork::JOIN:
+            tasks[cur].segs.push_back(SimCost{ 0, 0 });
+            break;
+        }
+    }
+
+private:
+    /** @brief Tasks started but not finished, innermost last */
+    std::vector<int> stack;
+};
+
+
+/***** Simulation *****/
+
+/**
+ * @brief Enum type for scheduling policies
+ *
+ * Types of policies:
+ *      GREEDY: Central FIFO queue of ready tasks
+ *      STEAL:  Per-processor deques with random work stealing
+ */
+enum class SimPolicy { GREEDY, STEAL };
+
+/** @brief Cost model of a simulation, in abstract time units */
+struct SimCosts {
+    /** @brief Time per read */
+    double compute;
+
+    /** @brief Time per write or move at full bandwidth */
+    double memory;
+
+    /** @brief Time a processor spends starting the tasks of a fork */
+    double spawn;
+
+    /** @brief Time of one steal attempt, successful or not */
+    double steal;
+
+    /**
+     * @brief Processors that can write at full speed at once (0: no limit)
+     *
+     * With k processors running, writes and moves slow down by a factor of
+     * max(1, k / bandwidth).
+     */
+    double bandwidth;
+
+    SimCosts()
+      : compute(1.0), memory(1.0), spawn(100.0), steal(50.0),
+        bandwidth(0.0) {}
+};
+
+/** @brief Stretch of time a virtual processor spent in one state */
+struct SimSlice {
+    double start, end;
+
+    /** @brief 'R' running a segment, 'S' spawning, 'T' stealing */
+    char kind;
+};
+
+/** @brief Outcome of a simulation */
+struct SimResult {
+    /** @brief Time until the root task finished */
+    double makespan;
+
+    /** @brief Work and span of the DAG (see sim_work_span()) */
+    double work, span;
+
+    /** @brief Time spent spawning and stealing, summed over processors */
+    double overhead;
+
+    /** @brief Successful steals */
+    uint64_t steals;
+
+    /** @brief Slices of each processor, if requested */
+    std::vector<std::vector<SimSlice>> gantt;
+};
+
+/** @brief Time of a segment on its own */
+inline double sim_time(const SimCost& c, const SimCosts& costs) {
+    return c.compute * costs.compute + c.memory * costs.memory;
+}
+
+/**
+ * @brief Work and span of a recorded DAG
+ *
+ * Both include the spawn cost of every fork (paid by the forking task), but
+ * not steals, so the work is the time of a greedy run on one processor.
+ * Children are recorded after their parents, so a pass over the tasks in
+ * reverse order sees every child before its parent.
+ */
+inline void sim_work_span(const std::vector<SimTask>& tasks,
+                          const SimCosts& costs, double& work, double& span) {
+    std::vector<double> w(tasks.size()), d(tasks.size());
+    for (size_t i = tasks.size(); i-- > 0;) {
+        const SimTask& t = tasks[i];
+        w[i] = d[i] = 0.0;
+        for (const SimCost& c : t.segs) {
+            w[i] += sim_time(c, costs);
+            d[i] += sim_time(c, costs);
+        }
+        for (const std::pair<int, int>& f : t.forks) {
+            w[i] += costs.spawn + w[f.first] + w[f.second];
+            d[i] += costs.spawn + std::max(d[f.first], d[f.second]);
+        }
+    }
+    work = tasks.empty() ? 0.0 : w[0];
+    span = tasks.empty() ? 0.0 : d[0];
+}
+
+/** @brief Event driven replay of a DAG on virtual processors */
+class Simulator {
+public:
+    Simulator(const std::vector<SimTask>& tasks, int nprocs,
+              SimPolicy policy, const SimCosts& costs, bool gantt)
+      : tasks(tasks), policy(policy), costs(costs), record(gantt),
+        procs(std::max(nprocs, 1)), pending(tasks.size(), 0),
+        resume(tasks.size(), 0), now(0.0), done(false), rng(1) {
+        r.makespan = 0.0;
+        r.overhead = 0.0;
+        r.steals   = 0;
+        if (record)
+            r.gantt.resize(procs.size());
+        sim_work_span(tasks, costs, r.work, r.span);
+    }
+
+    SimResult run() {
+        if (tasks.empty())
+            return r;
+        if (policy == SimPolicy::GREEDY)
+            ready.push_back({ 0, 0 });
+        else
+            start(0, { 0, 0 });
+        while (!done) {
+            assign();
+            if (!advance())
+                break;
+        }
+        r.makespan = now;
+        return r;
+    }
+
+private:
+    typedef std::pair<int, int> Job;  // Task and segment
+
+    struct Proc {
+        /** @brief 0 idle, otherwise as SimSlice::kind */
+        char kind;
+        Job job;
+
+        /** @brief Time left at full speed, and the share of it that writes */
+        double left, mem_frac;
+
+        /** @brief Start of the current slice */
+        double since;
+
+        /** @brief Jobs left for thieves (work stealing only) */
+        std::deque<Job> jobs;
+
+        Proc() : kind(0), job(0, 0), left(0.0), mem_frac(0.0), since(0.0) {}
+    };
+
+    const std::vector<SimTask>& tasks;
+    SimPolicy policy;
+    SimCosts  costs;
+    bool      record;
+    std::vector<Proc> procs;
+
+    /** @brief Ready jobs (greedy only) */
+    std::deque<Job> ready;
+
+    /** @brief Unfinished children of each task, and where it resumes */
+    std::vector<int> pending, resume;
+
+    double   now;
+    bool     done;
+    uint64_t rng;
+    SimResult r;
+
+    /** @brief Deterministic xorshift generator for choosing victims */
+    uint64_t random() {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return rng;
+    }
+
+    void start(size_t p, Job job) {
+        const SimCost& c = tasks[job.first].segs[job.second];
+        double t = sim_time(c, costs);
+        begin(p, 'R', t);
+        procs[p].job      = job;
+        procs[p].mem_frac = t > 0.0 ? c.memory * costs.memory / t : 0.0;
+    }
+
+    void begin(size_t p, char kind, double t) {
+        procs[p].kind     = kind;
+        procs[p].left     = t;
+        procs[p].mem_frac = 0.0;
+        procs[p].since    = now;
+    }
+
+    /** @brief Hands work to the idle processors */
+    void assign() {
+        for (size_t p = 0; p < procs.size(); p++) {
+            Proc& q = procs[p];
+            if (q.kind)
+                continue;
+            if (policy == SimPolicy::GREEDY) {
+                if (!ready.empty()) {
+                    start(p, ready.front());
+                    ready.pop_front();
+                }
+            } else if (!q.jobs.empty()) {
+                Job job = q.jobs.back();
+                q.jobs.pop_back();
+                start(p, job);
+            } else if (procs.size() > 1) {
+                begin(p, 'T', std::max(costs.steal, 1e-3));
+            }
+        }
+    }
+
+    /** @brief Slowdown of a running processor from shared bandwidth */
+    double slowdown(const Proc& q, double k) const {
+        if (q.kind != 'R' || costs.bandwidth <= 0.0)
+            return 1.0;
+        return 1.0 + q.mem_frac * (std::max(1.0, k / costs.bandwidth) - 1.0);
+    }
+
+    /** @brief Advances to the next completion, false if nothing runs */
+    bool advance() {
+        double k = 0.0;
+        for (const Proc& q : procs)
+            k += q.kind == 'R';
+        double dt = -1.0;
+        for (const Proc& q : procs)
+            if (q.kind && (dt < 0.0 || q.left * slowdown(q, k) < dt))
+                dt = q.left * slowdown(q, k);
+        if (dt < 0.0)
+            return false;
+        now += dt;
+        std::vector<size_t> finished;
+        for (size_t p = 0; p < procs.size(); p++) {
+            Proc& q = procs[p];
+            if (!q.kind)
+                continue;
+            q.left -= dt / slowdown(q, k);
+            if (q.left <= 1e-9)
+                finished.push_back(p);
+        }
+        for (size_t p : finished)
+            finish(p);
+        return true;
+    }
+
+    void slice(size_t p) {
+        Proc& q = procs[p];
+        if (q.kind != 'R')
+            r.overhead += now - q.since;
+        if (!record)
+            return;
+        std::vector<SimSlice>& g = r.gantt[p];
+        if (!g.empty() && g.back().kind == q.kind && g.back().end == q.since)
+            g.back().end = now;
+        else
+            g.push_back({ q.since, now, q.kind });
+    }
+
+    void finish(size_t p) {
+        Proc& q = procs[p];
+        slice(p);
+        char kind = q.kind;
+        q.kind = 0;
+        if (kind == 'R') {
+            const SimTask& t = tasks[q.job.first];
+            if ((size_t)q.job.second >= t.forks.size()) {
+                task_done(p, q.job.first);
+            } else if (costs.spawn > 0.0) {
+                begin(p, 'S', costs.spawn);
+            } else {
+                fork(p);
+            }
+        } else if (kind == 'S') {
+            fork(p);
+        } else if (kind == 'T') {
+            size_t v = random() % (procs.size() - 1);
+            v += v >= p;
+            if (!procs[v].jobs.empty()) {
+                Job job = procs[v].jobs.front();
+                procs[v].jobs.pop_front();
+                r.steals++;
+                start(p, job);
+            }
+        }
+    }
+
+    void fork(size_t p) {
+        Job job = procs[p].job;
+        std::pair<int, int> f = tasks[job.first].forks[job.second];
+        pending[job.first] = 2;
+        resume[job.first]  = job.second + 1;
+        if (policy == SimPolicy::GREEDY) {
+            ready.push_back({ f.first, 0 });
+            ready.push_back({ f.second, 0 });
+        } else {
+            procs[p].jobs.push_back({ f.second, 0 });
+            start(p, { f.first, 0 });
+        }
+    }
+
+    void task_done(size_t p, int t) {
+        int parent = tasks[t].parent;
+        if (parent < 0) {
+            done = true;
+            return;
+        }
+        if (--pending[parent])
+            return;
+        Job job(parent, resume[parent]);
+        if (policy == SimPolicy::GREEDY)
+            ready.push_back(job);
+        else
+            start(p, job);
+    }
+};
+
+/** @brief Replays a recorded DAG on procs virtual processors */
+inline SimResult simulate(const std::vector<SimTask>& tasks, int procs,
+                          SimPolicy policy, const SimCosts& costs,
+                          bool gantt = false) {
+    return Simulator(tasks, procs, policy, costs, gantt).run();
+}
+
+/**
+ * @brief Draws the slices of a simulation as text, one row per processor
+ *
+ * Each column covers makespan / width of time and shows '#' if the
+ * processor mostly ran segments there, '+' if it mostly spawned or stole,
+ * and '.' if it was mostly idle.
+ */
+inline std::string sim_gantt(const SimResult& r, int width = 72) {
+    std::string out;
+    if (r.makespan <= 0.0)
+        return out;
+    double col = r.makespan / width;
+    for (size_t p = 0; p < r.gantt.size(); p++) {
+        std::vector<double> run(width, 0.0), ovh(width, 0.0);
+        for (const SimSlice& s : r.gantt[p]) {
+            int a = std::min(width - 1, (int)(s.start / col));
+            int b = std::min(width - 1, (int)(s.end / col));
+            for (int c = a; c <= b; c++) {
+                double lo = std::max(s.start, c * col);
+                double hi = std::min(s.end, (c + 1) * col);
+                if (hi > lo)
+                    (s.kind == 'R' ? run : ovh)[c] += hi - lo;
+            }
+        }
+        char label[32];
+        snprintf(label, sizeof(label), "P%-3zu |", p);
+        out += label;
+        for (int c = 0; c < width; c++)
+            out += run[c] + ovh[c] < col / 2 ? '.'
+                 : run[c] >= ovh[c]          ? '#' : '+';
+        out += "|\n";
+    }
+    return out;
+}
+
+#endif
@@ -0,0 +1,1263 @@
+/**
+ * @file  sorting_stats.h
+ * @brief Run statistics for sorting algorithms
+ *
+ * Defines the counters shared by every thread working on one sort run and a
+ * thread-local batch that the hot paths increment without synchronization.
+ * A batch is merged into its run with relaxed atomics whenever sort_flush()
+ * is called (the animator does so once per frame) and when its thread exits,
+ * so counting costs a plain increment on the sorting side.
+ *
+ * Threads are attached to a run with sort_bind(). Sorts that create their own
+ * threads should do so through sort_fork() so that the children report to the
+ * same run as their parent. Every attached thread holds a worker ID, the
+ * lowest one free in its run, so IDs are reused as threads come and go and
+ * never exceed the peak number of concurrent threads. On request (see
+ * sort_set_span()), sort_fork() also tracks the span (critical path) of a
+ * run; the work divided by the span is the most speedup the run's fork
+ * structure allows.
+ *
+ * A run can also be traced: every SortSpan opened by a thread of the run is
+ * buffered in the thread's batch and handed to the run's SortTrace when the
+ * batch is flushed, to be written as a Chrome trace (see write_trace() in
+ * sorting_report.h) once the run is over.
+ *
+ * A sort that picks among others by probing its input (see auto_sort() in
+ * sorting.h) records what it saw and picked in its run as a SortChoice.
+ *
+ * When sorting_alloc.cpp is linked in, the global operator new and delete
+ * also count the heap allocations made by the threads of each run, whoever
+ * makes them (scratch vectors, std::function copies, thread objects).
+ *
+ * For studies of sorts on expensive elements, sort_costs() adds an
+ * artificial latency to every comparison, element write, and element read
+ * that is counted, e.g. to model keys compared through storage or memory
+ * that is slow to write.
+ *
+ * Nothing here draws: the Counted element wrapper and counting_cmp() of
+ * sorting.h count the operations of a sort run outside the animator too.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#ifndef __SORTING_STATS_H__
+#define __SORTING_STATS_H__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+
+/***** Clocks *****/
+
+/** @brief Monotonic wall time in nanoseconds */
+inline int64_t sort_wall_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+/**
+ * @brief CPU time consumed by the calling thread in nanoseconds
+ *
+ * Falls back to process CPU time where per-thread clocks are unavailable.
+ */
+inline int64_t sort_cpu_ns() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return (int64_t)std::clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+
+/***** Costs *****/
+
+/**
+ * @brief Artificial costs of the counted operations of a sort, in ns
+ *
+ * Every comparison counted by sort_count_cmp(), every write of an element
+ * noted by sort_note_write(), and every read noted by sort_note_read()
+ * spins for its cost, so that the times of instrumented runs (Counted
+ * elements, counting_cmp(), and the animator) rank the sorts as if the
+ * elements were that expensive. Only the data being sorted is taken to be
+ * slow to write: when the run names it (see SortStats::track()), writes
+ * into temporaries and scratch buffers are free, and otherwise every
+ * write pays. Uninstrumented runs pay nothing. All costs are 0 by default;
+ * set them between runs.
+ */
+struct SortCosts {
+    /** @brief Latency of a comparison, e.g. a lookup of both keys */
+    int64_t cmp_ns;
+
+    /** @brief Penalty of writing into the data, e.g. on NVM or flash */
+    int64_t write_ns;
+
+    /** @brief Penalty of loading an element through a pointer */
+    int64_t indirect_ns;
+
+    SortCosts() : cmp_ns(0), write_ns(0), indirect_ns(0) {}
+
+    bool any() const {
+        return cmp_ns > 0 || write_ns > 0 || indirect_ns > 0;
+    }
+};
+
+/** @brief Costs paid by every later instrumented run */
+inline SortCosts& sort_costs() {
+    static SortCosts costs;
+    return costs;
+}
+
+/** @brief Busy-waits for ns nanoseconds (the thread keeps its core) */
+inline void sort_spin(int64_t ns) {
+    if (ns <= 0)
+        return;
+    int64_t end = sort_wall_ns() + ns;
+    while (sort_wall_ns() < end)
+        ;
+}
+
+
+/***** Counters *****/
+
+/** @brief Number of worker IDs a run hands out */
+const int SORT_MAX_WORKERS = 64;
+
+/**
+ * @brief Number of buckets of the task size histogram
+ *
+ * Bucket 0 holds empty tasks (and those of unknown size), and bucket b > 0
+ * those of 2^(b-1) to 2^b - 1 elements; the last bucket also holds anything
+ * larger.
+ */
+const int SORT_SIZE_BUCKETS = 33;
+
+/** @brief Histogram bucket of a task of n elements */
+inline int sort_size_bucket(size_t n) {
+    int b = 0;
+    while (n && b < SORT_SIZE_BUCKETS - 1) {
+        n >>= 1;
+        b++;
+    }
+    return b;
+}
+
+/**
+ * @brief Enum type for accesses to an element
+ *
+ * Types of accesses:
+ *      READ:  The element's value is loaded (to compare or copy it)
+ *      WRITE: An existing element is assigned a new value
+ *      MOVE:  A new element is constructed from an existing one, such as a
+ *             temporary
+ *
+ * Scratch buffers are created at full size before they are registered (see
+ * SortScratch), so filling one counts as writes, not moves.
+ */
+enum class SortAccess { READ, WRITE, MOVE };
+
+/**
+ * @brief Enum type for the events of sort_fork()
+ *
+ * Types of events, in the order a fork reports them on its thread:
+ *      FORK:  The calling task is about to start two tasks
+ *      BEGIN: A task starts (reported by the thread running it)
+ *      END:   A task has finished
+ *      JOIN:  Both tasks have finished and the calling task resumes
+ * Under a thread limit of 1 both tasks run on the caller, so the events of
+ * a whole run arrive in this nested order on a single thread.
+ */
+enum class SortFork { FORK, BEGIN, END, JOIN };
+
+/** @brief Observer of the element accesses made during a run */
+struct SortWatch {
+    virtual ~SortWatch() {}
+
+    /** @brief Called after the element at p has been accessed */
+    virtual void on_access(SortAccess kind, const void* p) = 0;
+
+    /**
+     * @brief Called when a scratch buffer is registered or released
+     *
+     * @param[in] data  First element of the buffer
+     * @param[in] n     Number of elements
+     * @param[in] size  Size of an element in bytes
+     * @param[in] live  True on registration, false on release
+     */
+    virtual void on_scratch(const void* /* data */, size_t /* n */,
+                            size_t /* size */, bool /* live */) {}
+
+    /** @brief Called at the fork and join points of sort_fork() */
+    virtual void on_fork(SortFork /* event */) {}
+};
+
+/** @brief Access made during a run, as recorded by SortAccessLog */
+struct SortAccessRecord {
+    /** @brief Wall time of the access in nanoseconds */
+    int64_t time;
+
+    SortAccess kind;
+
+    /** @brief Address of the element */
+    const void* p;
+};
+
+/** @brief Observer recording every access it sees */
+struct SortAccessLog : SortWatch {
+    std::mutex m;
+    std::vector<SortAccessRecord> records;
+
+    void on_access(SortAccess kind, const void* p) override {
+        int64_t now = sort_wall_ns();
+        std::lock_guard<std::mutex> lock(m);
+        records.push_back({ now, kind, p });
+    }
+};
+
+/** @brief Timed section of a run, as recorded by SortTrace */
+struct SortTraceEvent {
+    /** @brief Name of the section (a string literal) */
+    const char* name;
+
+    /**
+     * @brief Thread that ran it: its worker ID (see sort_bind), or a number
+     *        of its own from SORT_MAX_WORKERS on if it had none
+     */
+    int thread;
+
+    /** @brief Wall time of its start and its length in nanoseconds */
+    int64_t start, dur;
+
+    /** @brief Number of elements it covered (0 if not applicable) */
+    size_t n;
+};
+
+/** @brief Collects the sections traced by the threads of a run */
+struct SortTrace {
+    std::mutex m;
+    std::vector<SortTraceEvent> events;
+
+    /** @brief Adds the sections buffered by one thread */
+    void add(const std::vector<SortTraceEvent>& batch) {
+        std::lock_guard<std::mutex> lock(m);
+        events.insert(events.end(), batch.begin(), batch.end());
+    }
+
+    /** @brief Removes and returns every section collected so far */
+    std::vector<SortTraceEvent> take() {
+        std::lock_guard<std::mutex> lock(m);
+        std::vector<SortTraceEvent> out;
+        out.swap(events);
+        return out;
+    }
+};
+
+/** @brief Tasks forked during a run and what they cost (see sort_fork) */
+struct SortTasks {
+    /** @brief Tasks run by sort_fork(), two per fork */
+    uint64_t tasks;
+
+    /** @brief Threads started for them */
+    uint64_t spawned;
+
+    /** @brief Most threads bound to the run at once */
+    int peak;
+
+    /** @brief Elements the tasks covered in total */
+    uint64_t elems;
+
+    /** @brief CPU time spent starting threads, wall time joining them */
+    int64_t spawn_ns, join_ns;
+
+    /** @brief CPU time of the run, the useful work to compare them with */
+    int64_t cpu_ns;
+
+    /** @brief Number of tasks per size bucket (see sort_size_bucket) */
+    uint64_t sizes[SORT_SIZE_BUCKETS];
+
+    /** @brief Average elements per task (0 without tasks) */
+    double avg_size() const {
+        return tasks ? (double)elems / tasks : 0.0;
+    }
+};
+
+/** @brief Heap use of a run (see sorting_alloc.cpp) */
+struct SortHeap {
+    /** @brief Calls to operator new and delete */
+    uint64_t allocs, frees;
+
+    /** @brief Bytes requested in total */
+    uint64_t bytes;
+
+    /** @brief Most bytes allocated during the run and not yet freed */
+    int64_t peak;
+
+    /** @brief Number of worker IDs whose threads allocated */
+    int threads;
+};
+
+/** @brief What an adaptive sort saw of its input and which sort it ran */
+struct SortChoice {
+    /** @brief Name of the sort run (NULL if nothing was chosen) */
+    const char* engine;
+
+    /** @brief Elements, their size in bytes, and threads available */
+    size_t   n;
+    size_t   elem_size;
+    unsigned threads;
+
+    /** @brief Share of the sampled adjacent pairs already in order */
+    double   sorted;
+
+    /** @brief Ascending and descending runs counted (0 if not counted) */
+    size_t   runs;
+
+    /** @brief Share of the sampled elements equal to another sample */
+    double   dups;
+
+    /**
+     * @brief 1 if the comparator orders the elements by ascending key, -1 if
+     *        by descending key, 0 if not or without keys (see SortKey)
+     */
+    int      key_order;
+
+    /** @brief Smallest and largest sampled key */
+    int64_t  key_lo, key_hi;
+
+    SortChoice()
+      : engine(NULL), n(0), elem_size(0), threads(0), sorted(0.0),
+        runs(0), dups(0.0), key_order(0), key_lo(0), key_hi(0) {}
+};
+
+/** @brief Statistics of one sort run, shared by all of its threads */
+struct SortStats {
+    /** @brief Comparisons performed */
+    std::atomic<uint64_t> comparisons;
+
+    /** @brief Element values loaded */
+    std::atomic<uint64_t> reads;
+
+    /** @brief Assignments into elements */
+    std::atomic<uint64_t> writes;
+
+    /** @brief Elements constructed from other elements */
+    std::atomic<uint64_t> moves;
+
+    /** @brief Exchanges of two elements (see sort_swap) */
+    std::atomic<uint64_t> swaps;
+
+    /** @brief Scratch buffers allocated */
+    std::atomic<uint64_t> allocs;
+
+    /** @brief Bytes of auxiliary memory currently in use */
+    std::atomic<int64_t> aux_bytes;
+
+    /** @brief Largest value aux_bytes has reached */
+    std::atomic<int64_t> aux_peak;
+
+    /**
+     * @brief Calls to operator new and delete made by the run's threads, and
+     *        the bytes requested (only counted with sorting_alloc.cpp)
+     */
+    std::atomic<uint64_t> heap_allocs, heap_frees, heap_bytes;
+
+    /** @brief Heap bytes the run allocated and has not freed, and its peak */
+    std::atomic<int64_t> heap_live, heap_peak;
+
+    /** @brief Bit i is set once worker i has allocated */
+    std::atomic<uint64_t> heap_workers;
+
+    /** @brief CPU time summed over every thread of the run */
+    std::atomic<int64_t> cpu_ns;
+
+    /** @brief Wall times at which the run started and stopped (0 if not) */
+    std::atomic<int64_t> start_ns, stop_ns;
+
+    /** @brief Bit i is set while worker i is held by a thread */
+    std::atomic<uint64_t> workers_live;
+
+    /** @brief Bit i is set while worker i waits for other threads */
+    std::atomic<uint64_t> workers_waiting;
+
+    /** @brief Largest number of workers held at once */
+    std::atomic<int> workers_peak;
+
+    /** @brief Wall time each worker spent running (not waiting) */
+    std::atomic<int64_t> worker_busy_ns[SORT_MAX_WORKERS];
+
+    /** @brief Threads started by sort_fork() under a limit and still alive */
+    std::atomic<unsigned> forked;
+
+    /** @brief Tasks run by sort_fork() and the elements they covered */
+    std::atomic<uint64_t> tasks, task_elems;
+
+    /** @brief Tasks run by sort_fork() per size bucket */
+    std::atomic<uint64_t> task_sizes[SORT_SIZE_BUCKETS];
+
+    /** @brief Threads started by sort_fork() */
+    std::atomic<uint64_t> spawned;
+
+    /** @brief Threads bound to the run now, and the most at once */
+    std::atomic<int> threads_live, threads_peak;
+
+    /**
+     * @brief CPU time sort_fork() spent starting threads, and wall time it
+     *        spent waiting to join them
+     */
+    std::atomic<int64_t> spawn_ns, join_ns;
+
+    /**
+     * @brief Span of the run: time along its critical path
+     *
+     * Together with the work (the time of a serial run), bounds the speedup
+     * any number of threads could give to work / span_ns.
+     */
+    std::atomic<int64_t> span_ns;
+
+    /** @brief Observers of the run's accesses */
+    std::vector<SortWatch*> watches;
+
+    /** @brief Where the run's sections are traced to (NULL if nowhere) */
+    SortTrace* trace;
+
+    /**
+     * @brief Data being sorted (NULL if not given, see track()), the only
+     *        memory whose writes pay SortCosts::write_ns
+     */
+    const void* data;
+    size_t      data_bytes;
+
+    /** @brief Choice of the last adaptive sort of the run */
+    std::mutex choice_m;
+    SortChoice choice;
+
+    SortStats() : trace(NULL), data(NULL), data_bytes(0) { reset(); }
+
+    /** @brief Names the data the run sorts (set before every run) */
+    template <class T>
+    void track(const std::vector<T>& v) {
+        data       = v.data();
+        data_bytes = v.size() * sizeof(T);
+    }
+
+    /** @brief True if p lies in the data being sorted, or none is given */
+    bool holds(const void* p) const {
+        uintptr_t a = (uintptr_t)p, lo = (uintptr_t)data;
+        return !data || (lo <= a && a < lo + data_bytes);
+    }
+
+    /**
+     * @brief Zeroes every counter (the observers, trace, and data are kept)
+     */
+    void reset() {
+        comparisons = 0;
+        reads       = 0;
+        writes      = 0;
+        moves       = 0;
+        swaps       = 0;
+        allocs      = 0;
+        aux_bytes   = 0;
+        aux_peak    = 0;
+        heap_allocs  = 0;
+        heap_frees   = 0;
+        heap_bytes   = 0;
+        heap_live    = 0;
+        heap_peak    = 0;
+        heap_workers = 0;
+        cpu_ns      = 0;
+        start_ns    = 0;
+        stop_ns     = 0;
+        workers_live    = 0;
+        workers_waiting = 0;
+        workers_peak    = 0;
+        for (int i = 0; i < SORT_MAX_WORKERS; i++)
+            worker_busy_ns[i] = 0;
+        forked          = 0;
+        span_ns         = 0;
+        tasks           = 0;
+        task_elems      = 0;
+        for (int i = 0; i < SORT_SIZE_BUCKETS; i++)
+            task_sizes[i] = 0;
+        spawned         = 0;
+        threads_live    = 0;
+        threads_peak    = 0;
+        spawn_ns        = 0;
+        join_ns         = 0;
+        std::lock_guard<std::mutex> lock(choice_m);
+        choice = SortChoice();
+    }
+
+    /** @brief Marks the start of the run */
+    void start() {
+        start_ns = sort_wall_ns();
+        stop_ns  = 0;
+    }
+
+    /** @brief Marks the end of the run */
+    void stop() {
+        stop_ns = sort_wall_ns();
+    }
+
+    /** @brief Wall time of the run so far in seconds */
+    double elapsed() const {
+        int64_t t0 = start_ns.load(), t1 = stop_ns.load();
+        if (!t0)
+            return 0.0;
+        return ((t1 ? t1 : sort_wall_ns()) - t0) * 1e-9;
+    }
+
+    /** @brief Comparisons and writes per second of wall time */
+    double throughput() const {
+        double t = elapsed();
+        return t > 0.0 ? (comparisons.load() + writes.load()) / t : 0.0;
+    }
+
+    /** @brief Adds (or with a negative value, removes) auxiliary memory */
+    void add_aux(int64_t bytes) {
+        int64_t now  = aux_bytes.fetch_add(bytes, std::memory_order_relaxed)
+                     + bytes;
+        int64_t peak = aux_peak.load(std::memory_order_relaxed);
+        while (now > peak && !aux_peak.compare_exchange_weak(peak, now))
+            ;
+    }
+
+    /** @brief Tasks forked so far */
+    SortTasks fork_tasks() const {
+        SortTasks t;
+        t.tasks    = tasks;
+        t.spawned  = spawned;
+        t.peak     = threads_peak;
+        t.elems    = task_elems;
+        t.spawn_ns = spawn_ns;
+        t.join_ns  = join_ns;
+        t.cpu_ns   = cpu_ns;
+        for (int i = 0; i < SORT_SIZE_BUCKETS; i++)
+            t.sizes[i] = task_sizes[i];
+        return t;
+    }
+
+    /** @brief Choice of the last adaptive sort so far */
+    SortChoice chosen() {
+        std::lock_guard<std::mutex> lock(choice_m);
+        return choice;
+    }
+
+    /** @brief Heap use so far */
+    SortHeap heap() const {
+        SortHeap h;
+        h.allocs  = heap_allocs;
+        h.frees   = heap_frees;
+        h.bytes   = heap_bytes;
+        h.peak    = heap_peak;
+        h.threads = 0;
+        for (uint64_t w = heap_workers; w; w &= w - 1)
+            h.threads++;
+        return h;
+    }
+
+    /** @brief Takes the lowest free worker ID (-1 if all are taken) */
+    int claim_worker() {
+        uint64_t live = workers_live.load();
+        int w;
+        do {
+            if (!~live)
+                return -1;
+            w = 0;
+            while (live >> w & 1)
+                w++;
+        } while (!workers_live.compare_exchange_weak(
+                     live, live | (uint64_t)1 << w));
+        int count = 1;
+        for (uint64_t x = live; x; x &= x - 1)
+            count++;
+        int peak = workers_peak.load();
+        while (count > peak && !workers_peak.compare_exchange_weak(peak, count))
+            ;
+        return w;
+    }
+
+    /** @brief Gives back a worker ID */
+    void release_worker(int w) {
+        if (w >= 0)
+            workers_live.fetch_and(~((uint64_t)1 << w));
+    }
+};
+
+/** @brief Unsynchronized counters of the calling thread */
+struct SortBatch {
+    /** @brief Run that the counters are merged into (NULL if none) */
+    SortStats* stats;
+
+    uint64_t comparisons;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t moves;
+    uint64_t swaps;
+
+    /** @brief Thread CPU time at the last flush */
+    int64_t cpu_mark;
+
+    /** @brief Worker ID of the thread within its run (-1 if none) */
+    int worker;
+
+    /** @brief Wall time at which the worker last started running */
+    int64_t busy_mark;
+
+    /**
+     * @brief Span of the strand the thread runs, up to span_mark
+     *
+     * A strand is a task of sort_fork() (or a whole run). Its span is the
+     * time it spent itself plus, at every fork, the longer span of the two
+     * tasks it waited for.
+     */
+    int64_t span_ns;
+
+    /** @brief Wall time at which the strand last resumed */
+    int64_t span_mark;
+
+    /** @brief Sections traced since the last flush (see SortSpan) */
+    std::vector<SortTraceEvent> trace;
+
+    SortBatch()
+      : stats(NULL), comparisons(0), reads(0), writes(0), moves(0), swaps(0),
+        cpu_mark(0), worker(-1), busy_mark(0), span_ns(0), span_mark(0) {}
+    ~SortBatch() { flush(); }
+
+    /** @brief Merges the counters into the bound run and zeroes them */
+    void flush() {
+        if (stats) {
+            std::memory_order r = std::memory_order_relaxed;
+            int64_t now = sort_cpu_ns();
+            stats->comparisons.fetch_add(comparisons, r);
+            stats->reads.fetch_add(reads, r);
+            stats->writes.fetch_add(writes, r);
+            stats->moves.fetch_add(moves, r);
+            stats->swaps.fetch_add(swaps, r);
+            stats->cpu_ns.fetch_add(now - cpu_mark, r);
+            cpu_mark = now;
+            if (stats->trace && !trace.empty())
+                stats->trace->add(trace);
+        }
+        trace.clear();
+        comparisons = 0;
+        reads       = 0;
+        writes      = 0;
+        moves       = 0;
+        swaps       = 0;
+    }
+};
+
+/** @brief Batch of the calling thread */
+inline SortBatch& sort_batch() {
+    static thread_local SortBatch batch;
+    return batch;
+}
+
+/** @brief Merges the calling thread's batch into its run */
+inline void sort_flush() {
+    sort_batch().flush();
+}
+
+/**
+ * @brief Run and worker ID of the calling thread, as seen by the heap hooks
+ *
+ * A copy of the batch's that is a plain thread-local, so that operator new
+ * can read it without constructing the batch (which may itself allocate).
+ */
+struct SortHeapTag {
+    SortStats* stats;
+    int        worker;
+};
+
+/** @brief Heap tag of the calling thread */
+inline SortHeapTag& sort_heap_tag() {
+    static thread_local SortHeapTag tag = { NULL, -1 };
+    return tag;
+}
+
+/** @brief True once sorting_alloc.cpp has replaced operator new and delete */
+inline std::atomic<bool>& sort_heap_hooked() {
+    static std::atomic<bool> hooked(false);
+    return hooked;
+}
+
+/**
+ * @brief Counts an allocation of bytes (or a release, when negative) made
+ *        by the calling thread towards its run
+ */
+inline void sort_count_heap(int64_t bytes) {
+    SortHeapTag& tag = sort_heap_tag();
+    SortStats* s = tag.stats;
+    if (!s)
+        return;
+    std::memory_order r = std::memory_order_relaxed;
+    if (bytes < 0) {
+        s->heap_frees.fetch_add(1, r);
+        s->heap_live.fetch_add(bytes, r);
+        return;
+    }
+    s->heap_allocs.fetch_add(1, r);
+    s->heap_bytes.fetch_add(bytes, r);
+    if (tag.worker >= 0)
+        s->heap_workers.fetch_or((uint64_t)1 << tag.worker, r);
+    int64_t now  = s->heap_live.fetch_add(bytes, r) + bytes;
+    int64_t peak = s->heap_peak.load(r);
+    while (now > peak && !s->heap_peak.compare_exchange_weak(peak, now))
+        ;
+}
+
+/** @brief True while sort_fork() tracks spans */
+inline std::atomic<bool>& sort_span_enabled() {
+    static std::atomic<bool> enabled(false);
+    return enabled;
+}
+
+/**
+ * @brief Turns span tracking on or off for later runs
+ *
+ * Spans add up wall time, so they are only exact while no strand waits for
+ * a core: measure them in a run of their own with a thread limit of 1 (see
+ * sort_set_threads()). The tasks of sort_fork() have the same work and span
+ * however they are scheduled.
+ */
+inline void sort_set_span(bool enabled) {
+    sort_span_enabled() = enabled;
+}
+
+/**
+ * @brief Attaches the calling thread to a run
+ *
+ * Anything counted before is flushed to the previous run. Binding NULL
+ * detaches the thread; do so before the run is destroyed.
+ */
+inline void sort_bind(SortStats* stats) {
+    SortBatch& b = sort_batch();
+    b.flush();
+    if (b.stats && sort_span_enabled()) {
+        // The strand that started the run has the longest span
+        int64_t span = b.span_ns + sort_wall_ns() - b.span_mark;
+        int64_t old  = b.stats->span_ns.load();
+        while (span > old && !b.stats->span_ns.compare_exchange_weak(old, span))
+            ;
+    }
+    if (b.stats && b.worker >= 0) {
+        b.stats->worker_busy_ns[b.worker] += sort_wall_ns() - b.busy_mark;
+        b.stats->release_worker(b.worker);
+    }
+    if (b.stats)
+        b.stats->threads_live--;
+    if (stats) {
+        int live = ++stats->threads_live;
+        int peak = stats->threads_peak.load();
+        while (live > peak && !stats->threads_peak.compare_exchange_weak(
+                                  peak, live))
+            ;
+    }
+    b.stats     = stats;
+    b.cpu_mark  = sort_cpu_ns();
+    b.worker    = stats ? stats->claim_worker() : -1;
+    b.busy_mark = sort_wall_ns();
+    b.span_ns   = 0;
+    b.span_mark = b.busy_mark;
+    sort_heap_tag() = { stats, b.worker };
+}
+
+/** @brief Worker ID of the calling thread (-1 if none) */
+inline int sort_worker() {
+    return sort_batch().worker;
+}
+
+/**
+ * @brief Marks the calling thread as waiting for (or, when done is true,
+ *        no longer waiting for) other threads of its run
+ */
+inline void sort_wait(bool done = false) {
+    SortBatch& b = sort_batch();
+    if (!b.stats || b.worker < 0)
+        return;
+    uint64_t bit = (uint64_t)1 << b.worker;
+    int64_t now  = sort_wall_ns();
+    if (done) {
+        b.stats->workers_waiting.fetch_and(~bit);
+        b.busy_mark = now;
+    } else {
+        b.stats->worker_busy_ns[b.worker] += now - b.busy_mark;
+        b.stats->workers_waiting.fetch_or(bit);
+    }
+}
+
+/** @brief Run that the calling thread is attached to */
+inline SortStats* sort_bound() {
+    return sort_batch().stats;
+}
+
+/** @brief Records the choice of an adaptive sort in the bound run */
+inline void sort_note_choice(const SortChoice& c) {
+    SortStats* stats = sort_bound();
+    if (!stats)
+        return;
+    std::lock_guard<std::mutex> lock(stats->choice_m);
+    stats->choice = c;
+}
+
+/** @brief Counts one comparison */
+inline void sort_count_cmp() {
+    sort_batch().comparisons++;
+    sort_spin(sort_costs().cmp_ns);
+}
+
+/** @brief Counts one exchange of two elements */
+inline void sort_count_swap() {
+    sort_batch().swaps++;
+}
+
+/** @brief Reports an access to the observers of the calling thread's run */
+inline void sort_notify(SortAccess kind, const void* p) {
+    SortStats* stats = sort_batch().stats;
+    if (stats)
+        for (SortWatch* w : stats->watches)
+            w->on_access(kind, p);
+}
+
+/** @brief Reports a fork event to the observers of the calling thread's run */
+inline void sort_notify_fork(SortFork event) {
+    SortStats* stats = sort_batch().stats;
+    if (stats)
+        for (SortWatch* w : stats->watches)
+            w->on_fork(event);
+}
+
+/**
+ * @brief Traces a section of a sort for as long as the object lives
+ *
+ * Costs a check of the calling thread's run unless the run has a SortTrace.
+ * Spans opened by one thread must close in reverse order, which scoped
+ * objects guarantee.
+ */
+class SortSpan {
+public:
+    SortSpan(const char* name, size_t n = 0)
+      : name(name), n(n), start(0) {
+        SortStats* stats = sort_bound();
+        if (stats && stats->trace)
+            start = sort_wall_ns();
+    }
+
+    ~SortSpan() {
+        if (!start)
+            return;
+        static std::atomic<int> threads(SORT_MAX_WORKERS);
+        static thread_local int self = -1;
+        SortBatch& b = sort_batch();
+        int thread = b.worker;
+        if (thread < 0)
+            thread = self >= 0 ? self : (self = threads++);
+        b.trace.push_back({ name, thread, start, sort_wall_ns() - start, n });
+    }
+
+    SortSpan(const SortSpan&) = delete;
+    SortSpan& operator=(const SortSpan&) = delete;
+
+private:
+    const char* name;
+    size_t      n;
+    int64_t     start;
+};
+
+/** @brief Counts one read of the element at p and reports it */
+inline void sort_note_read(const void* p) {
+    sort_batch().reads++;
+    sort_spin(sort_costs().indirect_ns);
+    sort_notify(SortAccess::READ, p);
+}
+
+/** @brief Counts one write to the element at p and reports it */
+inline void sort_note_write(const void* p) {
+    SortBatch& b = sort_batch();
+    b.writes++;
+    int64_t ns = sort_costs().write_ns;
+    if (ns > 0 && (!b.stats || b.stats->holds(p)))
+        sort_spin(ns);
+    sort_notify(SortAccess::WRITE, p);
+}
+
+/** @brief Counts the construction of the element at p and reports it */
+inline void sort_note_move(const void* p) {
+    sort_batch().moves++;
+    sort_notify(SortAccess::MOVE, p);
+}
+
+
+/**
+ * @brief Registers a scratch buffer with the calling thread's run
+ *
+ * The buffer counts towards the run's auxiliary memory and is shown to the
+ * run's observers for as long as the object lives. Declare it right after
+ * the buffer so that it is released first, and do not resize the buffer
+ * while it is registered. The buffer must already hold its elements (size
+ * it, do not just reserve it), since observers may read all of it.
+ */
+class SortScratch {
+public:
+    template <class T>
+    SortScratch(const std::vector<T>& buf)
+      : stats(sort_bound()), data(buf.data()), n(buf.capacity()),
+        size(sizeof(T)) {
+        if (!stats)
+            return;
+        stats->allocs++;
+        stats->add_aux((int64_t)(n * size));
+        for (SortWatch* w : stats->watches)
+            w->on_scratch(data, n, size, true);
+    }
+
+    ~SortScratch() {
+        if (!stats)
+            return;
+        for (SortWatch* w : stats->watches)
+            w->on_scratch(data, n, size, false);
+        stats->add_aux(-(int64_t)(n * size));
+    }
+
+    SortScratch(const SortScratch&) = delete;
+    SortScratch& operator=(const SortScratch&) = delete;
+
+private:
+    SortStats*  stats;
+    const void* data;
+    size_t      n, size;
+};
+
+
+/**
+ * @brief Element wrapper that counts the accesses made to it
+ *
+ * Copy construction counts a read of the source and a move, assignment a
+ * read and a write, as SortingDatum does in the animator, but nothing is
+ * drawn. Converts to the wrapped value, so comparators written for V work
+ * unchanged (such conversions are not counted as reads).
+ */
+template <class V>
+struct Counted {
+    V value;
+
+    Counted() : value() {}
+    Counted(const V& v) : value(v) {}
+
+    Counted(const Counted& c) : value(c.value) {
+        sort_note_read(&c);
+        sort_note_move(this);
+    }
+
+    Counted& operator=(const Counted& c) {
+        sort_note_read(&c);
+        value = c.value;
+        sort_note_write(this);
+        return *this;
+    }
+
+    operator const V&() const { return value; }
+};
+
+
+/***** Threads *****/
+
+/** @brief Most threads a run may use at once, 0 for no limit */
+inline std::atomic<unsigned>& sort_thread_limit() {
+    static std::atomic<unsigned> limit(0);
+    return limit;
+}
+
+/**
+ * @brief Limits the threads of every later run of a parallel sort
+ *
+ * @param[in] n  Most threads working on a run at once, counting the thread
+ *               that started it; 0 (the default) restores the classic
+ *               behaviour of two new threads per fork
+ */
+inline void sort_set_threads(unsigned n) {
+    sort_thread_limit() = n;
+}
+
+/**
+ * @brief Takes one of the threads a run may still start
+ *
+ * Runs that are not bound share one budget.
+ *
+ * @return Counter to give the thread back to, NULL if none is left
+ */
+inline std::atomic<unsigned>* sort_take_thread(unsigned limit) {
+    static std::atomic<unsigned> unbound(0);
+    SortStats* stats = sort_bound();
+    std::atomic<unsigned>& forked = stats ? stats->forked : unbound;
+    unsigned f = forked.load();
+    do {
+        if (f + 1 >= limit)
+            return NULL;
+    } while (!forked.compare_exchange_weak(f, f + 1));
+    return &forked;
+}
+
+/** @brief Span of the calling thread's strand so far (0 if not tracked) */
+inline int64_t sort_span() {
+    if (!sort_span_enabled().load(std::memory_order_relaxed))
+        return 0;
+    SortBatch& b = sort_batch();
+    return b.span_ns + sort_wall_ns() - b.span_mark;
+}
+
+/** @brief Runs a task as a new strand of this thread and returns its span */
+template <class F>
+int64_t sort_strand(F task) {
+    if (!sort_span_enabled().load(std::memory_order_relaxed)) {
+        task();
+        return 0;
+    }
+    SortBatch& b = sort_batch();
+    b.span_ns   = 0;
+    b.span_mark = sort_wall_ns();
+    task();
+    return sort_span();
+}
+
+/**
+ * @brief Resumes the strand that forked, after both of its tasks joined
+ *
+ * @param[in] before  Span of the strand when it forked
+ * @param[in] tasks   Longer span of the two tasks
+ */
+inline void sort_join_span(int64_t before, int64_t tasks) {
+    if (!sort_span_enabled().load(std::memory_order_relaxed))
+        return;
+    SortBatch& b = sort_batch();
+    b.span_ns   = before + tasks;
+    b.span_mark = sort_wall_ns();
+}
+
+/** @brief Counts the two tasks of a fork towards the calling thread's run */
+inline void sort_count_tasks(size_t head_n, size_t tail_n) {
+    SortStats* stats = sort_bound();
+    if (!stats)
+        return;
+    std::memory_order r = std::memory_order_relaxed;
+    stats->tasks.fetch_add(2, r);
+    stats->task_elems.fetch_add(head_n + tail_n, r);
+    stats->task_sizes[sort_size_bucket(head_n)].fetch_add(1, r);
+    stats->task_sizes[sort_size_bucket(tail_n)].fetch_add(1, r);
+}
+
+/**
+ * @brief Runs two tasks in parallel and waits for both
+ *
+ * Without a thread limit, each task gets its own thread bound to the
+ * caller's run. Under a limit (see sort_set_threads()), the head gets a new
+ * thread only while the run has one to spare and the caller runs the tail
+ * itself; otherwise both run on the caller, one after the other. The caller
+ * is marked as waiting while it has nothing left to do but join.
+ *
+ * Either way, each task is a strand of its own, so the span of the caller
+ * grows by the longer of the two, however they were scheduled, and the
+ * run's observers see the fork through SortWatch::on_fork(). The run also
+ * counts the tasks, their sizes, the threads started, the CPU time spent
+ * starting them, and the time spent waiting to join them (see SortTasks).
+ *
+ * @param[in] head_n  Number of elements the head works on (0 if unknown)
+ * @param[in] tail_n  Number of elements the tail works on (0 if unknown)
+ */
+template <class F, class G>
+void sort_fork(F head, G tail, size_t head_n = 0, size_t tail_n = 0) {
+    SortStats* stats = sort_bound();
+    unsigned limit = sort_thread_limit();
+    int64_t before = sort_span(), hs = 0, ts = 0;
+    auto h = [&]() {
+        sort_notify_fork(SortFork::BEGIN);
+        hs = sort_strand(head);
+        sort_notify_fork(SortFork::END);
+    };
+    auto t = [&]() {
+        sort_notify_fork(SortFork::BEGIN);
+        ts = sort_strand(tail);
+        sort_notify_fork(SortFork::END);
+    };
+    sort_notify_fork(SortFork::FORK);
+    sort_count_tasks(head_n, tail_n);
+    SortSpan fork("fork");
+    std::atomic<unsigned>* slot = limit ? sort_take_thread(limit) : NULL;
+    int64_t spawned = 0, spawn_ns = 0, join_ns = 0;
+    if (!limit) {
+        std::thread ht, tt;
+        {
+            SortSpan spawn("spawn");
+            int64_t t0 = sort_cpu_ns();
+            ht = std::thread([&]() { sort_bind(stats); h(); sort_bind(NULL); });
+            tt = std::thread([&]() { sort_bind(stats); t(); sort_bind(NULL); });
+            spawn_ns = sort_cpu_ns() - t0;
+            spawned  = 2;
+        }
+        SortSpan join("join");
+        int64_t t0 = sort_wall_ns();
+        sort_wait();
+        ht.join();
+        tt.join();
+        sort_wait(true);
+        join_ns = sort_wall_ns() - t0;
+    } else if (!slot) {
+        h();
+        t();
+    } else {
+        std::thread ht;
+        {
+            SortSpan spawn("spawn");
+            int64_t t0 = sort_cpu_ns();
+            ht = std::thread([&]() {
+                sort_bind(stats);
+                h();
+                sort_bind(NULL);
+                (*slot)--;
+            });
+            spawn_ns = sort_cpu_ns() - t0;
+            spawned  = 1;
+        }
+        t();
+        SortSpan join("join");
+        int64_t t0 = sort_wall_ns();
+        sort_wait();
+        ht.join();
+        sort_wait(true);
+        join_ns = sort_wall_ns() - t0;
+    }
+    if (stats && spawned) {
+        stats->spawned  += spawned;
+        stats->spawn_ns += spawn_ns;
+        stats->join_ns  += join_ns;
+    }
+    sort_join_span(before, std::max(hs, ts));
+    sort_notify_fork(SortFork::JOIN);
+}
+
+
+/***** Formatting *****/
+
+/** @brief Formats a count with a k/M/G suffix */
+inline std::string format_count(double x) {
+    const char* suffix[] = { "", "k", "M", "G", "T" };
+    int i = 0;
+    while (x >= 1000.0 && i < 4) {
+        x /= 1000.0;
+        i++;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), i ? "%.1f%s" : "%.0f%s", x, suffix[i]);
+    return buf;
+}
+
+/** @brief Formats a number of bytes with a binary suffix */
+inline std::string format_bytes(double x) {
+    const char* suffix[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    int i = 0;
+    while (x >= 1024.0 && i < 4) {
+        x /= 1024.0;
+        i++;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), i ? "%.1f %s" : "%.0f %s", x, suffix[i]);
+    return buf;
+}
+
+/** @brief Formats the heap use of a run, e.g. "12 allocs, 1.5 KiB, ..." */
+inline std::string format_heap(const SortHeap& h) {
+    return std::to_string(h.allocs) + " allocs, " + format_bytes(h.bytes)
+         + ", peak " + format_bytes(h.peak) + ", "
+         + std::to_string(h.threads) + (h.threads == 1 ? " thread"
+                                                        : " threads");
+}
+
+/**
+ * @brief Formats a choice, e.g. "radix: n 10.0k, 4 B, 8 threads, 50% in
+ *        order, 1% equal, keys 0..9999 ascending"
+ */
+inline std::string format_choice(const SortChoice& c) {
+    if (!c.engine)
+        return "";
+    char buf[192];
+    int len = snprintf(buf, sizeof(buf), "%s: n %s, %zu B, %u thread%s, "
+                       "%.0f%% in order, %.0f%% equal", c.engine,
+                       format_count((double)c.n).c_str(), c.elem_size,
+                       c.threads, c.threads == 1 ? "" : "s",
+                       100.0 * c.sorted, 100.0 * c.dups);
+    if (c.runs && len > 0 && len < (int)sizeof(buf))
+        len += snprintf(buf + len, sizeof(buf) - len, ", %zu run%s",
+                        c.runs, c.runs == 1 ? "" : "s");
+    if (c.key_order && len > 0 && len < (int)sizeof(buf))
+        snprintf(buf + len, sizeof(buf) - len, ", keys %lld..%lld %s",
+                 (long long)c.key_lo, (long long)c.key_hi,
+                 c.key_order > 0 ? "ascending" : "descending");
+    return buf;
+}
+
+/** @brief Formats a duration given in seconds */
+inline std::string format_secs(double s) {
+    char buf[32];
+    if (s < 1e-3)
+        snprintf(buf, sizeof(buf), "%.1f us", s * 1e6);
+    else if (s < 1.0)
+        snprintf(buf, sizeof(buf), "%.1f ms", s * 1e3);
+    else
+        snprintf(buf, sizeof(buf), "%.2f s", s);
+    return buf;
+}
+
+/** @brief Formats a cost model, e.g. "cmp 100 ns, write 1000 ns, ..." */
+inline std::string format_costs(const SortCosts& c) {
+    return "cmp " + std::to_string(c.cmp_ns) + " ns, write "
+         + std::to_string(c.write_ns) + " ns, indirect "
+         + std::to_string(c.indirect_ns) + " ns";
+}
+
+/** @brief Formats the tasks of a run, e.g. "62 tasks, avg 129.0 elems, ..." */
+inline std::string format_tasks(const SortTasks& t) {
+    char buf[160];
+    snprintf(buf, sizeof(buf), "%llu tasks, avg %.1f elems, %llu threads "
+             "(peak %d), spawn %s (%.1f%% of cpu), join %s",
+             (unsigned long long)t.tasks, t.avg_size(),
+             (unsigned long long)t.spawned, t.peak,
+             format_secs(t.spawn_ns * 1e-9).c_str(),
+             t.cpu_ns ? 100.0 * t.spawn_ns / t.cpu_ns : 0.0,
+             format_secs(t.join_ns * 1e-9).c_str());
+    return buf;
+}
+
+/**
+ * @brief Formats the task size histogram, one "lo-hi count" per nonempty
+ *        bucket
+ */
+inline std::string format_task_sizes(const SortTasks& t,
+                                     const char* sep = "  ") {
+    std::string s;
+    for (int b = 0; b < SORT_SIZE_BUCKETS; b++) {
+        if (!t.sizes[b])
+            continue;
+        char buf[64];
+        if (b <= 1)
+            snprintf(buf, sizeof(buf), "%d", b);
+        else
+            snprintf(buf, sizeof(buf), "%s-%s",
+                     format_count((double)(1ull << (b - 1))).c_str(),
+                     format_count((double)((1ull << b) - 1)).c_str());
+        s += (s.empty() ? "" : sep) + std::string(buf) + " "
+           + format_count((double)t.sizes[b]);
+    }
+    return s;
+}
+
+#endif
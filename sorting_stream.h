@@ -0,0 +1,128 @@
+/**
+ * @file  sorting_stream.h
+ * @brief Memory bandwidth probe to measure sorts against
+ *
+ * Measures the sustainable memory bandwidth of the host the way the STREAM
+ * benchmark does: the copy (c = a) and triad (a = b + s c) kernels run over
+ * arrays much larger than the caches, split evenly over a number of
+ * threads, and the best of a few repetitions counts. A sort of n elements
+ * of size s reads and writes at least 2 n s bytes, so dividing that by its
+ * time gives the bandwidth of one pass over its data; compared with the
+ * copy bandwidth, it tells how many passes the memory could have made in
+ * the same time, i.e. how far a memory bound sort is from the hardware
+ * limit.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#ifndef __SORTING_STREAM_H__
+#define __SORTING_STREAM_H__
+
+#include "sorting_stats.h"
+#include <vector>
+#include <thread>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+
+
+/** @brief Bandwidth of the STREAM kernels on some number of threads */
+struct StreamResult {
+    unsigned threads;
+
+    /** @brief Bytes read and written per second by copy and triad */
+    double copy, triad;
+};
+
+/**
+ * @brief Runs copy and triad over three arrays of the given size
+ *
+ * @param[in] bytes    Size of each array (use several times the LLC)
+ * @param[in] threads  Threads sharing the arrays
+ * @param[in] reps     Repetitions; the fastest counts
+ */
+inline StreamResult stream_probe(size_t bytes, unsigned threads,
+                                 int reps = 5) {
+    threads = std::max(1u, threads);
+    size_t n = std::max<size_t>(bytes / sizeof(double), threads);
+    std::vector<double> a(n, 1.0), b(n, 2.0), c(n, 0.0);
+    const double s = 3.0;
+
+    // Runs kernel(lo, hi) on every thread's share, returning the seconds
+    auto run = [&](auto kernel) {
+        std::vector<std::thread> pool;
+        int64_t t0 = sort_wall_ns();
+        for (unsigned t = 1; t < threads; t++)
+            pool.push_back(std::thread(kernel, t * n / threads,
+                                       (t + 1) * n / threads));
+        kernel(0, n / threads);
+        for (std::thread& th : pool)
+            th.join();
+        return (sort_wall_ns() - t0) * 1e-9;
+    };
+    auto copy = [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+            c[i] = a[i];
+    };
+    auto triad = [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+            a[i] = b[i] + s * c[i];
+    };
+
+    StreamResult r = { threads, 0.0, 0.0 };
+    for (int k = 0; k < reps; k++) {
+        double tc = run(copy), tt = run(triad);
+        if (tc > 0.0)
+            r.copy  = std::max(r.copy, 2.0 * n * sizeof(double) / tc);
+        if (tt > 0.0)
+            r.triad = std::max(r.triad, 3.0 * n * sizeof(double) / tt);
+    }
+    return r;
+}
+
+/**
+ * @brief Copy bandwidth available to a run on the given number of threads
+ *
+ * Takes the probe with the most threads not above it, or the first probe.
+ *
+ * @pre The probes are in increasing order of threads
+ */
+inline double stream_bandwidth(const std::vector<StreamResult>& probes,
+                               int threads) {
+    double bw = probes.empty() ? 0.0 : probes.front().copy;
+    for (const StreamResult& p : probes)
+        if ((int)p.threads <= threads)
+            bw = p.copy;
+    return bw;
+}
+
+/** @brief Formats a bandwidth given in bytes per second, e.g. "12.3 GB/s" */
+inline std::string format_bandwidth(double bytes_per_s) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.2f GB/s", bytes_per_s * 1e-9);
+    return buf;
+}
+
+/**
+ * @brief Formats the throughput of a sort of n elements of the given size
+ *        that took secs, against the copy bandwidth bw, e.g. "12.3M keys/s,
+ *        pass 1.2 GB/s (10% of copy, 10.0 passes)"
+ */
+inline std::string format_roofline(size_t n, size_t size, double secs,
+                                   double bw) {
+    if (secs <= 0.0)
+        return "";
+    double pass = 2.0 * n * size / secs;
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s keys/s, pass %s",
+             format_count(n / secs).c_str(), format_bandwidth(pass).c_str());
+    std::string s = buf;
+    if (bw > 0.0) {
+        snprintf(buf, sizeof(buf), " (%.1f%% of copy, %.1f passes)",
+                 100.0 * pass / bw, bw / pass);
+        s += buf;
+    }
+    return s;
+}
+
+#endif
@@ -0,0 +1,254 @@
+/**
+ * @file  sorting_tuning.h
+ * @brief Cutoffs of the hybrid sorts and their automatic tuning
+ *
+ * The sorts of sorting.h read four parameters from sort_tuning():
+ *      - leaf: ranges of at most this many elements are insertion sorted
+ *        instead of recursed into
+ *      - grain: the parallel sorts stop forking below this many elements
+ *        and finish the range serially
+ *      - pivot_sample: quick sorts take the median of this many samples of
+ *        the range as their pivot
+ *      - radix_bits: radix sort distributes the keys by digits of this many
+ *        bits, one pass per digit
+ * The defaults (1, 0, 1) keep the comparison sorts exactly as they were
+ * written, and 8-bit digits are the default of radix sort. The best values
+ * depend on the host, so the benchmark can search them (see tune() and
+ * sorting_bench.cpp --tune) and save them to a per-host profile, which the
+ * animator and the benchmark load at startup.
+ *
+ * @author David Chen <dchen2@andrew.cmu.edu>
+ */
+
+#ifndef __SORTING_TUNING_H__
+#define __SORTING_TUNING_H__
+
+#include "sorting_report.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+
+
+/** @brief Parameters of the hybrid sorts */
+struct SortTuning {
+    /** @brief Longest range insertion sorted at the leaves */
+    size_t leaf;
+
+    /** @brief Shortest range the parallel sorts still fork */
+    size_t grain;
+
+    /** @brief Samples the pivot of a quick sort is the median of */
+    size_t pivot_sample;
+
+    /** @brief Bits per digit of radix sort */
+    size_t radix_bits;
+
+    SortTuning() : leaf(1), grain(0), pivot_sample(1), radix_bits(8) {}
+};
+
+/** @brief Parameters used by every later sort (set before sorting) */
+inline SortTuning& sort_tuning() {
+    static SortTuning tuning;
+    return tuning;
+}
+
+
+/***** Profiles *****/
+
+/**
+ * @brief Path of the profile of this host
+ *
+ * The SORT_TUNING environment variable overrides the default of
+ * sort_tuning.<host>.json in the working directory.
+ */
+inline std::string sort_tuning_path() {
+    const char* env = getenv("SORT_TUNING");
+    if (env && *env)
+        return env;
+    return "sort_tuning." + report_hostname() + ".json";
+}
+
+/** @brief Largest value a profile may give a parameter */
+const double SORT_TUNING_MAX = 1e12;
+
+/** @brief Widest digit of radix sort, which keeps 2^bits buckets */
+const size_t SORT_RADIX_MAX_BITS = 16;
+
+/**
+ * @brief Tells what is wrong with a setting
+ *
+ * The sorts need leaf >= 1 (merge sort would split single elements
+ * forever), an odd pivot_sample >= 1 (an even sample has no middle
+ * element), and 1 <= radix_bits <= SORT_RADIX_MAX_BITS.
+ *
+ * @return Description of the first bad parameter, or "" if there is none
+ */
+inline std::string check_tuning(const SortTuning& t) {
+    if (t.leaf < 1)
+        return "leaf must be at least 1";
+    if (t.pivot_sample < 1 || t.pivot_sample % 2 == 0)
+        return "pivot_sample must be odd and at least 1";
+    if (t.radix_bits < 1 || t.radix_bits > SORT_RADIX_MAX_BITS)
+        return "radix_bits must be between 1 and "
+             + std::to_string(SORT_RADIX_MAX_BITS);
+    return "";
+}
+
+/**
+ * @brief Loads a profile into sort_tuning()
+ *
+ * A profile with a parameter that is not a whole number up to
+ * SORT_TUNING_MAX, or that fails check_tuning(), is ignored with a warning
+ * and sort_tuning() falls back to the defaults.
+ *
+ * @return False (leaving sort_tuning() alone) if the file is missing or
+ *         malformed, or false after resetting it if the values are bad
+ */
+inline bool sort_load_tuning(const std::string& path) {
+    JsonValue v;
+    if (!read_json(path, v))
+        return false;
+    const JsonValue& t = v["tuning"];
+    if (t.type != JsonType::OBJECT)
+        return false;
+    SortTuning tuning = sort_tuning();
+    const struct {
+        const char*          name;
+        size_t SortTuning::* field;
+    } fields[] = {
+        { "leaf",         &SortTuning::leaf },
+        { "grain",        &SortTuning::grain },
+        { "pivot_sample", &SortTuning::pivot_sample },
+        { "radix_bits",   &SortTuning::radix_bits },
+    };
+    std::string bad;
+    for (const auto& f : fields) {
+        double x = t[f.name].num((double)(tuning.*f.field));
+        if (!(x >= 0.0 && x <= SORT_TUNING_MAX && x == std::floor(x))) {
+            bad = std::string(f.name) + " must be a whole number from 0 to "
+                + std::to_string((uint64_t)SORT_TUNING_MAX);
+            break;
+        }
+        tuning.*f.field = (size_t)x;
+    }
+    if (bad.empty())
+        bad = check_tuning(tuning);
+    if (!bad.empty()) {
+        fprintf(stderr, "Ignoring tuning profile %s: %s\n", path.c_str(),
+                bad.c_str());
+        sort_tuning() = SortTuning();
+        return false;
+    }
+    sort_tuning() = tuning;
+    return true;
+}
+
+/** @brief Saves sort_tuning() as a profile, along with the host */
+inline bool sort_save_tuning(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    const SortTuning& t = sort_tuning();
+    fprintf(f, "{\n  \"host\": %s,\n", json_host(report_host()).c_str());
+    fprintf(f, "  \"tuning\": {\"leaf\": %zu, \"grain\": %zu, "
+               "\"pivot_sample\": %zu, \"radix_bits\": %zu}\n}\n",
+            t.leaf, t.grain, t.pivot_sample, t.radix_bits);
+    return fclose(f) == 0;
+}
+
+/**
+ * @brief Formats a setting, e.g. "leaf 16, grain 4096, pivot 3, radix 8"
+ */
+inline std::string format_tuning(const SortTuning& t) {
+    return "leaf " + std::to_string(t.leaf) + ", grain "
+         + std::to_string(t.grain) + ", pivot "
+         + std::to_string(t.pivot_sample) + ", radix "
+         + std::to_string(t.radix_bits);
+}
+
+
+/***** Search *****/
+
+/** @brief Parameter searched by tune() */
+struct TuneParam {
+    /** @brief Name in profiles and output */
+    const char* name;
+
+    /** @brief Member of SortTuning holding the parameter */
+    size_t SortTuning::* field;
+
+    /** @brief Values to choose from, in increasing order */
+    std::vector<size_t> values;
+};
+
+/** @brief Every parameter tune() searches, with its candidate values */
+inline std::vector<TuneParam> tune_params() {
+    std::vector<size_t> leaf, grain;
+    for (size_t x = 1; x <= 256; x *= 2)
+        leaf.push_back(x);
+    grain.push_back(0);
+    for (size_t x = 64; x <= (1 << 20); x *= 4)
+        grain.push_back(x);
+    std::vector<size_t> pivot = { 1, 3, 5, 7, 9, 15 };
+    std::vector<size_t> radix = { 4, 6, 8, 10, 11, 12, 16 };
+    return {
+        { "leaf",         &SortTuning::leaf,         leaf },
+        { "grain",        &SortTuning::grain,        grain },
+        { "pivot_sample", &SortTuning::pivot_sample, pivot },
+        { "radix_bits",   &SortTuning::radix_bits,   radix },
+    };
+}
+
+/**
+ * @brief Searches the parameters by hill climbing
+ *
+ * Starting from start, each parameter in turn moves to a neighbouring
+ * candidate for as long as that lowers the cost by more than margin
+ * (relative), and the rounds repeat until no parameter moves. Costs are
+ * measured, so the margin keeps noise from steering the search.
+ *
+ * @param[in] cost    Cost of a setting, measured for the given parameter
+ * @param[in] rounds  Most rounds over the parameters
+ * @param[in] margin  Relative improvement a move needs
+ * @return Best setting found
+ */
+inline SortTuning tune(SortTuning start,
+                       std::function<double(const SortTuning&,
+                                            const TuneParam&)> cost,
+                       int rounds = 3, double margin = 0.02) {
+    SortTuning best = start;
+    std::vector<TuneParam> params = tune_params();
+    for (int round = 0; round < rounds; round++) {
+        bool moved = false;
+        for (const TuneParam& p : params) {
+            // Start from the candidate nearest to the current value
+            size_t i = 0;
+            while (i + 1 < p.values.size() && p.values[i] < best.*p.field)
+                i++;
+            best.*p.field = p.values[i];
+            double here = cost(best, p);
+            for (int dir : { 1, -1 }) {
+                while (dir > 0 ? i + 1 < p.values.size() : i > 0) {
+                    SortTuning next = best;
+                    next.*p.field = p.values[i + dir];
+                    double c = cost(next, p);
+                    if (c >= here * (1.0 - margin))
+                        break;
+                    best  = next;
+                    here  = c;
+                    i    += dir;
+                    moved = true;
+                }
+            }
+        }
+        if (!moved)
+            break;
+    }
+    return best;
+}
+
+#endif